@@ -10,6 +10,100 @@
 #endif
 
 #include "geometry.h"
+#include "render.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+// ------ Mat4 ------ //
+
+Mat4 Mat4::identity()
+{
+    return Mat4{{
+        1, 0, 0, 0, // x
+        0, 1, 0, 0, // y
+        0, 0, 1, 0, // z
+        0, 0, 0, 1, // w
+    }};
+}
+
+/// @brief Same matrix glTranslatef would multiply by
+Mat4 Mat4::translation(Vec3 offset)
+{
+    auto result = identity();
+    result.m[12] = offset.x;
+    result.m[13] = offset.y;
+    result.m[14] = offset.z;
+    return result;
+}
+
+/// @brief Same matrix glScalef would multiply by
+Mat4 Mat4::scaling(Vec3 scale)
+{
+    auto result = identity();
+    result.m[0] = scale.x;
+    result.m[5] = scale.y;
+    result.m[10] = scale.z;
+    return result;
+}
+
+/// @brief Same matrix glOrtho would multiply by
+Mat4 Mat4::orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    auto result = identity();
+    result.m[0] = 2 / (right - left);
+    result.m[5] = 2 / (top - bottom);
+    result.m[10] = -2 / (zFar - zNear);
+    result.m[12] = -(right + left) / (right - left);
+    result.m[13] = -(top + bottom) / (top - bottom);
+    result.m[14] = -(zFar + zNear) / (zFar - zNear);
+    return result;
+}
+
+/// @brief Same matrix glRotatef would multiply by
+Mat4 Mat4::rotation(float degrees, Vec3 axis)
+{
+    auto n = axis.normalized();
+    float radians = degrees * M_PI / 180;
+    float c = cos(radians);
+    float s = sin(radians);
+    float t = 1 - c;
+
+    return Mat4{{
+        n.x * n.x * t + c, n.y * n.x * t + n.z * s, n.x * n.z * t - n.y * s, 0,
+        n.x * n.y * t - n.z * s, n.y * n.y * t + c, n.y * n.z * t + n.x * s, 0,
+        n.x * n.z * t + n.y * s, n.y * n.z * t - n.x * s, n.z * n.z * t + c, 0,
+        0, 0, 0, 1,
+    }};
+}
+
+Mat4 Mat4::operator*(Mat4 other)
+{
+    Mat4 result;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            float sum = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                sum += m[k * 4 + row] * other.m[col * 4 + k];
+            }
+            result.m[col * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+Vec3 Mat4::transformPoint(Vec3 p)
+{
+    return {
+        m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+        m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+        m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14],
+    };
+}
 
 // ------ BoundingBox ------ //
 
@@ -166,6 +260,11 @@ void Polygon::draw()
     glEnd();
 }
 
+void Polygon::render(RenderBackend *backend)
+{
+    backend->drawPolygon(*this);
+}
+
 // ---- Frustum ---- //
 
 Frustum::Frustum(Polygon base1, Polygon base2, Vec3 color)
@@ -239,6 +338,14 @@ void Frustum::draw()
     }
 }
 
+void Frustum::render(RenderBackend *backend)
+{
+    for (Polygon &polygon : polygons)
+    {
+        polygon.render(backend);
+    }
+}
+
 std::vector<Polygon> Frustum::getPolygons()
 {
     return polygons;
@@ -306,18 +413,7 @@ Box::~Box()
 
 void Box::identity()
 {
-    float matrix[16] = {
-        1, 0, 0, 0, // x
-        0, 1, 0, 0, // y
-        0, 0, 1, 0, // z
-        0, 0, 0, 1, // w
-    };
-
-    for (int i = 0; i < 16; i++)
-    {
-        this->matrix[i] = matrix[i];
-    }
-
+    this->matrix = Mat4::identity();
     this->scaleFactor = {1, 1, 1};
 }
 
@@ -348,7 +444,7 @@ void Box::draw()
 {
     glPushMatrix();
 
-    glMultMatrixf(this->matrix);
+    glMultMatrixf(this->matrix.m);
     
     // center the box
     // auto size = this->bounds().size();
@@ -362,13 +458,21 @@ void Box::draw()
     glPopMatrix();
 }
 
+void Box::render(RenderBackend *backend)
+{
+    backend->pushMatrix();
+    backend->multMatrix(matrix);
+    for (Drawable *child : children)
+    {
+        child->render(backend);
+    }
+    backend->popMatrix();
+}
+
+// composed on the CPU, so a scene can be built before any GL context exists
 Box* Box::scale(Vec3 scale)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glScalef(scale.x, scale.y, scale.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::scaling(scale);
     this->scaleFactor = this->scaleFactor.multComps(scale);
     return this;
 }
@@ -380,22 +484,15 @@ Box* Box::scale(float scale) {
 Box* Box::move(Vec3 pos)
 {
     pos = pos.multComps(this->scaleFactor.reciprocal());
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glTranslatef(pos.x, pos.y, pos.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::translation(pos);
     return this;
 }
 
 Box* Box::rotate(Vec3 rot)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glRotatef(rot.x, 1, 0, 0);
-    glRotatef(rot.y, 0, 1, 0);
-    glRotatef(rot.z, 0, 0, 1);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix
+                 * Mat4::rotation(rot.x, {1, 0, 0})
+                 * Mat4::rotation(rot.y, {0, 1, 0})
+                 * Mat4::rotation(rot.z, {0, 0, 1});
     return this;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
+#pragma once
 #include <vector>
 #include <initializer_list>
+#include "math.h"
 
 struct Vec3 {
     float x, y, z;
@@ -15,6 +17,21 @@ struct Vec3 {
     Vec3 reciprocal();
 };
 
+/// @brief Column-major 4x4 matrix laid out like OpenGL's, so it can be
+/// handed to glMultMatrixf directly. Composes on the CPU without a context.
+struct Mat4 {
+    float m[16];
+    static Mat4 identity();
+    static Mat4 translation(Vec3 offset);
+    static Mat4 scaling(Vec3 scale);
+    static Mat4 rotation(float degrees, Vec3 axis);
+    static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar);
+    Mat4 operator*(Mat4 other);
+    Vec3 transformPoint(Vec3 point);
+};
+
+class RenderBackend;
+
 struct BoundingBox {
     Vec3 min, max;
     Vec3 center();
@@ -25,6 +42,8 @@ struct Drawable {
     virtual void draw() = 0;
     virtual ~Drawable() {};
     virtual BoundingBox bounds() = 0;
+    /// @brief draw() through any backend, GL or not.
+    virtual void render(RenderBackend *backend) = 0;
 };
 
 class Prism;
@@ -44,6 +63,7 @@ struct Polygon : public Drawable {
     Prism* extrude(Vec3 extrusion);
     void draw();
     BoundingBox bounds();
+    void render(RenderBackend *backend);
 };
 
 class Frustum : public Drawable {
@@ -56,6 +76,7 @@ class Frustum : public Drawable {
         void draw();
         std::vector<Polygon> getPolygons();
         BoundingBox bounds();
+        void render(RenderBackend *backend);
         Box* boxed();
     private:
         std::vector<Polygon> polygons;
@@ -69,7 +90,7 @@ class Prism : public Frustum {
 
 class Box : public Drawable {
     private:
-        float matrix[16];
+        Mat4 matrix;
         Vec3 scaleFactor = {1, 1, 1};
 
     public:
@@ -82,6 +103,7 @@ class Box : public Drawable {
         void identity();
         BoundingBox bounds();
         void draw();
+        void render(RenderBackend *backend);
         Box* scale(Vec3 scale);
         Box* scale(float scale);
         Box* move(Vec3 pos);
@@ -22,8 +22,10 @@
 #define M_PI 3.14159265
 #endif
 
+#include <chrono>
+
 #include "models/buff.h"
-// #include "geometry.h"
+#include "render.h"
 
 struct orbit
 {
@@ -34,6 +36,9 @@ struct orbit
 } orbit;
 
 Box *scene;
+Vec3 background;
+int headlessFrames = 0;
+const char *headlessImage = "headless.ppm";
 
 #define LEN 8192 //  Maximum length of text string
 void Print(const char *format, ...)
@@ -158,8 +163,7 @@ void visible(int vis)
 
 void initScene()
 {
-   auto bgColor = Vec3{.4, .5, 1} / 4;
-   glClearColor(bgColor.x, bgColor.y, bgColor.z, 1);
+   background = Vec3{.4, .5, 1} / 4;
 
    auto mainBuff = buildBuff()
                        ->rotate({0, (float)(rand() % 360), 0});
@@ -200,8 +204,55 @@ void initScene()
    scene = new Box({mainBuff, altBuff, altBuff2, altBuff3, altBuff4, floor});
 }
 
+// -------- Headless -------- //
+/// @brief Nothing here moves, so this times the same still frame of the buffs
+/// drawn over and over by the software rasterizer, then writes it. No axes.
+int renderHeadless(int frames, const char *path)
+{
+   const int size = 600;
+   SoftwareRasterizer raster(size, size);
+   const float dim = orbit.dim;
+   raster.projection = Mat4::orthographic(-dim, dim, -dim, dim, -dim, dim * 2);
+
+   auto view = Mat4::rotation(orbit.pitch, {1, 0, 0}) * Mat4::rotation(orbit.yaw, {0, 1, 0});
+   auto start = std::chrono::steady_clock::now();
+   for (int frame = 0; frame < frames; frame++)
+   {
+      raster.clear(background);
+      raster.loadMatrix(view);
+      scene->render(&raster);
+      raster.finish();
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   printf("Rendered %d frames of %d triangles at %dx%d in %.2f s (%.1f FPS)\n",
+          frames, raster.triangleCount(), size, size, elapsed.count(), frames / elapsed.count());
+   if (!raster.writePPM(path))
+   {
+      fprintf(stderr, "Could not write %s\n", path);
+      return 1;
+   }
+   printf("Wrote %s\n", path);
+   return 0;
+}
+
 int main(int argc, char *argv[])
 {
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+         headlessFrames = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-ppm") == 0 && i + 1 < argc)
+         headlessImage = argv[i + 1];
+   }
+
+   // with -headless there is no window to open, just frames to time
+   if (headlessFrames > 0)
+   {
+      initScene();
+      return renderHeadless(headlessFrames, headlessImage);
+   }
+
    //  Initialize GLUT and process user parameters
    glutInit(&argc, argv);
 
@@ -229,6 +280,7 @@ int main(int argc, char *argv[])
    glFrontFace(GL_CCW);
 
    initScene();
+   glClearColor(background.x, background.y, background.z, 1);
 
    glutDisplayFunc(draw);
    glutReshapeFunc(reshape);
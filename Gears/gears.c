@@ -4,6 +4,16 @@
  * Command line options:
  *    -info      print GL implementation information
  *    -exit      automatically exit after 30 seconds
+ *    -gears N   draw a train of N gears instead of the three
+ *    -teeth T   teeth on the train's larger gears (20 by default)
+ *    -noinstance  draw gear by gear even where instancing is available
+ *    -bench N   render N frames at a fixed step, print frame time statistics
+ *               as JSON and exit
+ *    -warmup W  frames rendered before -bench starts timing (30 by default)
+ *    -json F    write the -bench JSON to file F instead of stdout
+ *
+ * Compiled with -DOSMESA it renders offscreen through OSMesa, with no window
+ * system, and always runs the benchmark.
  *
  *
  * Brian Paul
@@ -19,11 +29,19 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #ifdef USEGLEW
 #include <GL/glew.h>
 #endif
 #define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
+#ifdef OSMESA
+#ifdef __has_include
+#if !__has_include(<GL/osmesa.h>)
+#error "gears-osmesa needs OSMesa (GL/osmesa.h, libOSMesa), e.g. libosmesa6-dev"
+#endif
+#endif
+#include <GL/osmesa.h>
+#elif defined(__APPLE__)
 #include <GLUT/glut.h>
 #else
 #include <GL/glut.h>
@@ -38,17 +56,108 @@
 #define M_PI 3.14159265
 #endif
 
+static GLint autoexit = 0;
+static GLfloat view_rotx = 20.0, view_roty = 30.0, view_rotz = 0.0;
+static GLfloat angle = 0.0;
+#ifndef OSMESA
 static GLfloat fps = -1;
 static GLint T0 = 0;
 static GLint Frames = 0;
-static GLint autoexit = 0;
 static GLint win = 0;
+#endif
 
 
 /**
 
-  Draw a gear wheel.  You'll probably want to call this function when
-  building a display list since we do a lot of trig here.
+  Gear geometry as an indexed triangle mesh, interleaved position and
+  normal per vertex.  Every angle a gear uses is a whole number of
+  quarter teeth, so each angle's sin and cos is computed once into a
+  table and all the faces are assembled from it.  Faces that share a
+  plane share vertices; the rest get their own so their normals stay flat.
+
+ **/
+
+typedef struct {
+  GLfloat *vertices;   /* x y z nx ny nz */
+  GLuint *indices;
+  GLint nvertices, nindices;
+  GLint maxvertices, maxindices;
+} GearMesh;
+
+static GLuint
+mesh_vertex(GearMesh *m, GLfloat x, GLfloat y, GLfloat z,
+  GLfloat nx, GLfloat ny, GLfloat nz)
+{
+  GLfloat *v;
+
+  if (m->nvertices == m->maxvertices) {
+    m->maxvertices = m->maxvertices ? 2 * m->maxvertices : 256;
+    m->vertices = realloc(m->vertices, 6 * sizeof(GLfloat) * m->maxvertices);
+  }
+  v = m->vertices + 6 * m->nvertices;
+  v[0] = x;  v[1] = y;  v[2] = z;
+  v[3] = nx; v[4] = ny; v[5] = nz;
+  return m->nvertices++;
+}
+
+/* counterclockwise triangle */
+static void
+mesh_triangle(GearMesh *m, GLuint a, GLuint b, GLuint c)
+{
+  GLuint *t;
+
+  if (m->nindices + 3 > m->maxindices) {
+    m->maxindices = m->maxindices ? 2 * m->maxindices : 768;
+    m->indices = realloc(m->indices, sizeof(GLuint) * m->maxindices);
+  }
+  t = m->indices + m->nindices;
+  t[0] = a; t[1] = b; t[2] = c;
+  m->nindices += 3;
+}
+
+/* counterclockwise quad a b c d as two triangles */
+static void
+mesh_quad(GearMesh *m, GLuint a, GLuint b, GLuint c, GLuint d)
+{
+  mesh_triangle(m, a, b, c);
+  mesh_triangle(m, a, c, d);
+}
+
+static void
+mesh_free(GearMesh *m)
+{
+  free(m->vertices);
+  free(m->indices);
+  memset(m, 0, sizeof(GearMesh));
+}
+
+/* vertex on ring r at angle j of a face, made the first time it is asked for */
+static GLuint
+face_vertex(GearMesh *m, GLint *face, GLint n, GLint r, GLint j,
+  const GLfloat *radius, const GLfloat *c, const GLfloat *s, GLfloat z)
+{
+  GLint *slot = &face[r * n + j % n];
+  if (*slot < 0)
+    *slot = mesh_vertex(m, radius[r] * c[j], radius[r] * s[j], z, 0.0, 0.0, z > 0 ? 1.0 : -1.0);
+  return *slot;
+}
+
+/* flat outward quad from (x0,y0) to (x1,y1), spanning -z to z */
+static void
+side_quad(GearMesh *m, GLfloat nx, GLfloat ny,
+  GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1, GLfloat z)
+{
+  GLuint a = mesh_vertex(m, x0, y0, z, nx, ny, 0.0);
+  GLuint b = mesh_vertex(m, x0, y0, -z, nx, ny, 0.0);
+  GLuint c = mesh_vertex(m, x1, y1, -z, nx, ny, 0.0);
+  GLuint d = mesh_vertex(m, x1, y1, z, nx, ny, 0.0);
+  mesh_quad(m, a, b, c, d);
+}
+
+/**
+
+  Build a gear wheel into m, the same shape the old immediate mode
+  gear() drew.
  
   Input:  inner_radius - radius of hole at center
           outer_radius - radius at center of teeth
@@ -59,137 +168,427 @@ static GLint win = 0;
  **/
 
 static void
-gear(GLfloat inner_radius, GLfloat outer_radius, GLfloat width,
+gear_mesh(GearMesh *m, GLfloat inner_radius, GLfloat outer_radius, GLfloat width,
   GLint teeth, GLfloat tooth_depth)
 {
-  GLint i;
-  GLfloat r0, r1, r2;
-  GLfloat angle, da;
+  GLint i, j, n = 4 * teeth;
+  GLfloat radius[3], z = width * 0.5;
+  GLfloat *c = malloc((n + 1) * sizeof(GLfloat));
+  GLfloat *s = malloc((n + 1) * sizeof(GLfloat));
+  GLint *front = malloc(3 * n * sizeof(GLint));
+  GLint *back = malloc(3 * n * sizeof(GLint));
   GLfloat u, v, len;
 
-  r0 = inner_radius;
-  r1 = outer_radius - tooth_depth / 2.0;
-  r2 = outer_radius + tooth_depth / 2.0;
+  radius[0] = inner_radius;
+  radius[1] = outer_radius - tooth_depth / 2.0;
+  radius[2] = outer_radius + tooth_depth / 2.0;
 
-  da = 2.0 * M_PI / teeth / 4.0;
+  /* angle j is j quarter teeth round; the last repeats the first */
+  for (j = 0; j < n; j++) {
+    c[j] = cos(j * 2.0 * M_PI / n);
+    s[j] = sin(j * 2.0 * M_PI / n);
+  }
+  c[n] = c[0];
+  s[n] = s[0];
+  for (j = 0; j < 3 * n; j++)
+    front[j] = back[j] = -1;
 
-  glShadeModel(GL_FLAT);
+#define F(r, j) face_vertex(m, front, n, r, j, radius, c, s, z)
+#define B(r, j) face_vertex(m, back, n, r, j, radius, c, s, -z)
+  for (i = 0; i < teeth; i++) {
+    j = 4 * i;
 
-  glNormal3f(0.0, 0.0, 1.0);
+    /* front face and the front sides of the tooth */
+    mesh_triangle(m, F(0, j), F(1, j), F(1, j + 3));
+    mesh_quad(m, F(0, j), F(1, j + 3), F(1, j + 4), F(0, j + 4));
+    mesh_quad(m, F(1, j), F(2, j + 1), F(2, j + 2), F(1, j + 3));
 
-  /* draw front face */
-  glBegin(GL_QUAD_STRIP);
-  for (i = 0; i <= teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
-    glVertex3f(r0 * cos(angle), r0 * sin(angle), width * 0.5);
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), width * 0.5);
-    if (i < teeth) {
-      glVertex3f(r0 * cos(angle), r0 * sin(angle), width * 0.5);
-      glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), width * 0.5);
-    }
+    /* back face and the back sides of the tooth */
+    mesh_triangle(m, B(1, j), B(0, j), B(1, j + 3));
+    mesh_quad(m, B(1, j + 3), B(0, j), B(0, j + 4), B(1, j + 4));
+    mesh_quad(m, B(1, j + 3), B(2, j + 2), B(2, j + 1), B(1, j));
+
+    /* outward faces of the tooth: up the leading flank, across the top,
+       down the trailing flank, then along the root to the next tooth */
+    u = radius[2] * c[j + 1] - radius[1] * c[j];
+    v = radius[2] * s[j + 1] - radius[1] * s[j];
+    len = sqrt(u * u + v * v);
+    side_quad(m, v / len, -u / len, radius[1] * c[j], radius[1] * s[j],
+              radius[2] * c[j + 1], radius[2] * s[j + 1], z);
+    side_quad(m, c[j], s[j], radius[2] * c[j + 1], radius[2] * s[j + 1],
+              radius[2] * c[j + 2], radius[2] * s[j + 2], z);
+    u = radius[1] * c[j + 3] - radius[2] * c[j + 2];
+    v = radius[1] * s[j + 3] - radius[2] * s[j + 2];
+    len = sqrt(u * u + v * v);
+    side_quad(m, v / len, -u / len, radius[2] * c[j + 2], radius[2] * s[j + 2],
+              radius[1] * c[j + 3], radius[1] * s[j + 3], z);
+    side_quad(m, c[j], s[j], radius[1] * c[j + 3], radius[1] * s[j + 3],
+              radius[1] * c[j + 4], radius[1] * s[j + 4], z);
   }
-  glEnd();
+#undef F
+#undef B
 
-  /* draw front sides of teeth */
-  glBegin(GL_QUADS);
-  da = 2.0 * M_PI / teeth / 4.0;
+  /* inside radius cylinder, smooth, so neighbouring quads share vertices */
+  for (i = 0; i <= teeth; i++) {
+    j = 4 * i;
+    mesh_vertex(m, radius[0] * c[j], radius[0] * s[j], -z, -c[j], -s[j], 0.0);
+    mesh_vertex(m, radius[0] * c[j], radius[0] * s[j], z, -c[j], -s[j], 0.0);
+  }
   for (i = 0; i < teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
-
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), width * 0.5);
-    glVertex3f(r2 * cos(angle + da), r2 * sin(angle + da), width * 0.5);
-    glVertex3f(r2 * cos(angle + 2 * da), r2 * sin(angle + 2 * da), width * 0.5);
-    glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), width * 0.5);
+    GLuint k = m->nvertices - 2 * (teeth + 1) + 2 * i;
+    mesh_quad(m, k, k + 1, k + 3, k + 2);
   }
-  glEnd();
 
-  glNormal3f(0.0, 0.0, -1.0);
+  free(c);
+  free(s);
+  free(front);
+  free(back);
+}
+
+/* a gear mesh on the GPU */
+typedef struct {
+  GLuint buffers[2];   /* vertices, indices */
+  GLsizei count;
+} GearBuffer;
 
-  /* draw back face */
-  glBegin(GL_QUAD_STRIP);
-  for (i = 0; i <= teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), -width * 0.5);
-    glVertex3f(r0 * cos(angle), r0 * sin(angle), -width * 0.5);
-    if (i < teeth) {
-      glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), -width * 0.5);
-      glVertex3f(r0 * cos(angle), r0 * sin(angle), -width * 0.5);
-    }
+static void
+gear_upload(GearBuffer *g, GearMesh *m)
+{
+  glGenBuffers(2, g->buffers);
+  glBindBuffer(GL_ARRAY_BUFFER, g->buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(GLfloat) * m->nvertices, m->vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->buffers[1]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * m->nindices, m->indices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  g->count = m->nindices;
+}
+
+/* draw g instances times, or once without instancing when instances is 0 */
+static void
+gear_draw(GearBuffer *g, GLsizei instances)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, g->buffers[0]);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->buffers[1]);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), (void *) 0);
+  glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), (void *) (3 * sizeof(GLfloat)));
+  if (instances)
+    glDrawElementsInstanced(GL_TRIANGLES, g->count, GL_UNSIGNED_INT, (void *) 0, instances);
+  else
+    glDrawElements(GL_TRIANGLES, g->count, GL_UNSIGNED_INT, (void *) 0);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/**
+
+  A gear train.  Gears are instances of a few shared shapes, placed on the
+  plane, and each is driven by the one gear it meshes with, so the train
+  is a tree rooted at the input gear.  Every gear turns speed * angle +
+  phase degrees as the input turns angle.
+
+ **/
+
+#define GEAR_MODULE 0.2       /* pitch radius per tooth */
+#define GEAR_TOOTH_DEPTH 0.7
+#define GEAR_CLEARANCE 0.1    /* between meshing pitch circles */
+
+typedef struct {
+  GearBuffer buffer;
+  GLint teeth;
+  GLfloat radius;       /* pitch radius, where meshing teeth meet */
+  /* the gears of this shape for instanced drawing, rebuilt when dirty */
+  GLuint instances;
+  GLint ninstances, dirty;
+} GearShape;
+
+typedef struct {
+  GLint shape;
+  GLfloat color[4];
+  GLfloat x, y;
+  GLint driver;         /* -1 for the input gear */
+  /* gears this one drives, as a list through next_driven */
+  GLint first_driven, next_driven;
+  GLfloat speed, phase;
+} Gear;
+
+static GearShape *shapes = NULL;
+static GLint nshapes = 0;
+static Gear *gears = NULL;
+static GLint ngears = 0;
+/* -gears N and -teeth T replace the three gears with an N gear train */
+static GLint stress_gears = 0, stress_teeth = 20;
+static GLfloat scene_scale = 1.0, scene_x = 0.0, scene_y = 0.0;
+static GLint scene_triangles = 0;
+
+/* instanced drawing, when GL 3.3 is there for it; 'i' toggles */
+static GLuint instance_program = 0;
+static GLint instance_attrib, color_attrib, angle_uniform;
+static GLint use_instancing = 0;
+
+static GLint
+add_shape(GLfloat inner_radius, GLfloat width, GLint teeth)
+{
+  GearMesh m = {0};
+  GearShape *s;
+
+  shapes = realloc(shapes, (nshapes + 1) * sizeof(GearShape));
+  s = &shapes[nshapes];
+  gear_mesh(&m, inner_radius, teeth * GEAR_MODULE, width, teeth, GEAR_TOOTH_DEPTH);
+  gear_upload(&s->buffer, &m);
+  mesh_free(&m);
+  s->teeth = teeth;
+  s->radius = teeth * GEAR_MODULE;
+  glGenBuffers(1, &s->instances);
+  s->ninstances = 0;
+  s->dirty = 1;
+  return nshapes++;
+}
+
+/*
+ * Speed and phase of gear b from its driver a.  Speeds go inversely as
+ * tooth counts.  In tooth units, measured counterclockwise from the start
+ * of a tooth, a tooth rises from 0 to 0.25, is flat to 0.5 and falls to
+ * 0.75, and the gap takes the rest.  At the contact point a's and b's
+ * tooth coordinates must sum to 0.25, a's tooth centre (0.375) against
+ * b's gap centre (0.875); they run in opposite directions at the same
+ * rate, so fixing the sum at angle 0 keeps it for good.
+ */
+static void
+gear_solve(Gear *b)
+{
+  Gear *a = &gears[b->driver];
+  GLfloat na = shapes[a->shape].teeth, nb = shapes[b->shape].teeth;
+  GLfloat contact = atan2(b->y - a->y, b->x - a->x) * 180 / M_PI;
+  GLfloat ua = (contact - a->phase) * na / 360;
+
+  b->speed = -a->speed * na / nb;
+  b->phase = fmod(contact + 180 - 360 / nb * (0.25 - ua), 360);
+}
+
+/* solve the branch of the train that gear g drives, g included */
+static GLint
+train_solve(GLint g)
+{
+  GLint *stack = malloc(ngears * sizeof(GLint));
+  GLint n = 0, solved = 0, i, c;
+
+  stack[n++] = g;
+  while (n) {
+    i = stack[--n];
+    if (gears[i].driver >= 0)
+      gear_solve(&gears[i]);
+    solved++;
+    for (c = gears[i].first_driven; c >= 0; c = gears[c].next_driven)
+      stack[n++] = c;
   }
-  glEnd();
+  free(stack);
+  return solved;
+}
 
-  /* draw back sides of teeth */
-  glBegin(GL_QUADS);
-  da = 2.0 * M_PI / teeth / 4.0;
-  for (i = 0; i < teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
+/*
+ * Add a gear of shape at x,y driven by gear driver, or the input gear
+ * when driver is -1.  Only the new gear's own branch is solved, which
+ * is just the new gear.
+ */
+static GLint
+add_gear(GLint shape, const GLfloat color[4], GLfloat x, GLfloat y, GLint driver)
+{
+  Gear *g;
 
-    glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), -width * 0.5);
-    glVertex3f(r2 * cos(angle + 2 * da), r2 * sin(angle + 2 * da), -width * 0.5);
-    glVertex3f(r2 * cos(angle + da), r2 * sin(angle + da), -width * 0.5);
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), -width * 0.5);
+  gears = realloc(gears, (ngears + 1) * sizeof(Gear));
+  g = &gears[ngears];
+  g->shape = shape;
+  memcpy(g->color, color, sizeof(g->color));
+  g->x = x;
+  g->y = y;
+  g->driver = driver;
+  g->first_driven = -1;
+  g->next_driven = -1;
+  g->speed = 1.0;
+  g->phase = 0.0;
+  if (driver >= 0) {
+    g->next_driven = gears[driver].first_driven;
+    gears[driver].first_driven = ngears;
   }
-  glEnd();
+  ngears++;
+  train_solve(ngears - 1);
 
-  /* draw outward faces of teeth */
-  glBegin(GL_QUAD_STRIP);
-  for (i = 0; i < teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
+  shapes[shape].dirty = 1;
+  scene_triangles += shapes[shape].buffer.count / 3;
+  return ngears - 1;
+}
 
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), width * 0.5);
-    glVertex3f(r1 * cos(angle), r1 * sin(angle), -width * 0.5);
-    u = r2 * cos(angle + da) - r1 * cos(angle);
-    v = r2 * sin(angle + da) - r1 * sin(angle);
-    len = sqrt(u * u + v * v);
-    u /= len;
-    v /= len;
-    glNormal3f(v, -u, 0.0);
-    glVertex3f(r2 * cos(angle + da), r2 * sin(angle + da), width * 0.5);
-    glVertex3f(r2 * cos(angle + da), r2 * sin(angle + da), -width * 0.5);
-    glNormal3f(cos(angle), sin(angle), 0.0);
-    glVertex3f(r2 * cos(angle + 2 * da), r2 * sin(angle + 2 * da), width * 0.5);
-    glVertex3f(r2 * cos(angle + 2 * da), r2 * sin(angle + 2 * da), -width * 0.5);
-    u = r1 * cos(angle + 3 * da) - r2 * cos(angle + 2 * da);
-    v = r1 * sin(angle + 3 * da) - r2 * sin(angle + 2 * da);
-    glNormal3f(v, -u, 0.0);
-    glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), width * 0.5);
-    glVertex3f(r1 * cos(angle + 3 * da), r1 * sin(angle + 3 * da), -width * 0.5);
-    glNormal3f(cos(angle), sin(angle), 0.0);
+/* add a gear of shape meshing with driver, in direction degrees from it */
+static GLint
+mesh_gear(GLint shape, const GLfloat color[4], GLint driver, GLfloat direction)
+{
+  GLfloat d = shapes[gears[driver].shape].radius + shapes[shape].radius + GEAR_CLEARANCE;
+  return add_gear(shape, color, gears[driver].x + d * cos(direction * M_PI / 180),
+                  gears[driver].y + d * sin(direction * M_PI / 180), driver);
+}
+
+/*
+ * Instanced drawing: one draw per shape, each instance turned and lit in
+ * the vertex shader the way the fixed function pipeline lights the rest
+ */
+static const char *instance_shader =
+  "#version 120\n"
+  "attribute vec4 instance;  // x, y, speed, phase\n"
+  "attribute vec4 color;\n"
+  "uniform float angle;\n"
+  "void main()\n"
+  "{\n"
+  "  float a = radians(instance.z * angle + instance.w);\n"
+  "  mat2 turn = mat2(cos(a), sin(a), -sin(a), cos(a));\n"
+  "  vec3 n = normalize(gl_NormalMatrix * vec3(turn * gl_Normal.xy, gl_Normal.z));\n"
+  "  vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+  "  gl_FrontColor = vec4(color.rgb * (gl_LightModel.ambient.rgb\n"
+  "                  + gl_LightSource[0].diffuse.rgb * max(dot(n, l), 0.0)), color.a);\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix * vec4(turn * gl_Vertex.xy + instance.xy, gl_Vertex.z, 1.0);\n"
+  "}\n";
+
+static void
+init_instancing(void)
+{
+  const char *version = (const char *) glGetString(GL_VERSION);
+  GLint major = 0, minor = 0, ok;
+  GLuint shader;
+  char log[1024];
+
+  if (!version || sscanf(version, "%d.%d", &major, &minor) != 2 || 10 * major + minor < 33)
+    return;
+
+  shader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(shader, 1, &instance_shader, NULL);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "Instance shader: %s\n", log);
+    glDeleteShader(shader);
+    return;
   }
+  instance_program = glCreateProgram();
+  glAttachShader(instance_program, shader);
+  glLinkProgram(instance_program);
+  glDeleteShader(shader);
+  glGetProgramiv(instance_program, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    glGetProgramInfoLog(instance_program, sizeof(log), NULL, log);
+    fprintf(stderr, "Instance program: %s\n", log);
+    glDeleteProgram(instance_program);
+    instance_program = 0;
+    return;
+  }
+  instance_attrib = glGetAttribLocation(instance_program, "instance");
+  color_attrib = glGetAttribLocation(instance_program, "color");
+  angle_uniform = glGetUniformLocation(instance_program, "angle");
+  use_instancing = 1;
+}
 
-  glVertex3f(r1 * cos(0), r1 * sin(0), width * 0.5);
-  glVertex3f(r1 * cos(0), r1 * sin(0), -width * 0.5);
+/* x, y, speed, phase and colour of every gear of shape k */
+static void
+upload_instances(GLint k)
+{
+  GLfloat *data = malloc(8 * sizeof(GLfloat) * ngears), *d = data;
+  GLint i;
 
-  glEnd();
+  for (i = 0; i < ngears; i++) {
+    if (gears[i].shape != k)
+      continue;
+    d[0] = gears[i].x;
+    d[1] = gears[i].y;
+    d[2] = gears[i].speed;
+    d[3] = gears[i].phase;
+    memcpy(d + 4, gears[i].color, 4 * sizeof(GLfloat));
+    d += 8;
+  }
+  shapes[k].ninstances = (d - data) / 8;
+  glBindBuffer(GL_ARRAY_BUFFER, shapes[k].instances);
+  glBufferData(GL_ARRAY_BUFFER, (d - data) * sizeof(GLfloat), data, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  shapes[k].dirty = 0;
+  free(data);
+}
 
-  glShadeModel(GL_SMOOTH);
+static void
+draw_instanced(void)
+{
+  GLint k;
 
-  /* draw inside radius cylinder */
-  glBegin(GL_QUAD_STRIP);
-  for (i = 0; i <= teeth; i++) {
-    angle = i * 2.0 * M_PI / teeth;
-    glNormal3f(-cos(angle), -sin(angle), 0.0);
-    glVertex3f(r0 * cos(angle), r0 * sin(angle), -width * 0.5);
-    glVertex3f(r0 * cos(angle), r0 * sin(angle), width * 0.5);
+  glUseProgram(instance_program);
+  glUniform1f(angle_uniform, angle);
+  glEnableVertexAttribArray(instance_attrib);
+  glEnableVertexAttribArray(color_attrib);
+  glVertexAttribDivisor(instance_attrib, 1);
+  glVertexAttribDivisor(color_attrib, 1);
+
+  for (k = 0; k < nshapes; k++) {
+    if (shapes[k].dirty)
+      upload_instances(k);
+    if (!shapes[k].ninstances)
+      continue;
+    glBindBuffer(GL_ARRAY_BUFFER, shapes[k].instances);
+    glVertexAttribPointer(instance_attrib, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (void *) 0);
+    glVertexAttribPointer(color_attrib, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
+                          (void *) (4 * sizeof(GLfloat)));
+    gear_draw(&shapes[k].buffer, shapes[k].ninstances);
   }
-  glEnd();
 
+  glVertexAttribDivisor(instance_attrib, 0);
+  glVertexAttribDivisor(color_attrib, 0);
+  glDisableVertexAttribArray(instance_attrib);
+  glDisableVertexAttribArray(color_attrib);
+  glUseProgram(0);
 }
 
-static GLfloat view_rotx = 20.0, view_roty = 30.0, view_rotz = 0.0;
-static GLint gear1, gear2, gear3;
-static GLfloat angle = 0.0;
+
+/*
+ * -bench state.  Every frame advances the animation by the same step, so
+ * the frames drawn do not depend on how fast they were drawn.
+ */
+#define BENCH_STEP 2.0  /* degrees per frame */
+static GLint bench_frames = 0, bench_warmup = 30;
+static const char *bench_json = NULL;
+static GLint bench_done = 0;
+static double *bench_times = NULL;  /* seconds per timed frame */
+
+/* benchmarking, stdout carries just the JSON, so anything else goes to stderr */
+static FILE *
+diagnostics(void)
+{
+#ifdef OSMESA
+  return stderr;
+#else
+  return bench_frames > 0 ? stderr : stdout;
+#endif
+}
 
 static void
 cleanup(void)
 {
-   glDeleteLists(gear1, 1);
-   glDeleteLists(gear2, 1);
-   glDeleteLists(gear3, 1);
+   GLint i;
+   for (i = 0; i < nshapes; i++) {
+      glDeleteBuffers(2, shapes[i].buffer.buffers);
+      glDeleteBuffers(1, &shapes[i].instances);
+   }
+   if (instance_program)
+      glDeleteProgram(instance_program);
+   free(shapes);
+   free(gears);
+   free(bench_times);
+#ifndef OSMESA
    glutDestroyWindow(win);
+#endif
 }
 
 
+#ifndef OSMESA
 #define LEN 8192  //  Maximum length of text string
 static void
 Print(const char* format , ...)
@@ -205,10 +604,13 @@ Print(const char* format , ...)
    while (*ch)
       glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
 }
+#endif
 
 static void
-draw(void)
+render(void)
 {
+  GLint i;
+
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   glPushMatrix();
@@ -216,25 +618,114 @@ draw(void)
     glRotatef(view_roty, 0.0, 1.0, 0.0);
     glRotatef(view_rotz, 0.0, 0.0, 1.0);
 
-    glPushMatrix();
-      glTranslatef(-3.0, -2.0, 0.0);
-      glRotatef(angle, 0.0, 0.0, 1.0);
-      glCallList(gear1);
-    glPopMatrix();
-
-    glPushMatrix();
-      glTranslatef(3.1, -2.0, 0.0);
-      glRotatef(-2.0 * angle - 9.0, 0.0, 0.0, 1.0);
-      glCallList(gear2);
-    glPopMatrix();
+    glScalef(scene_scale, scene_scale, scene_scale);
+    glTranslatef(-scene_x, -scene_y, 0.0);
 
-    glPushMatrix();
-      glTranslatef(-3.1, 4.2, 0.0);
-      glRotatef(-2.0 * angle - 25.0, 0.0, 0.0, 1.0);
-      glCallList(gear3);
-    glPopMatrix();
+    if (use_instancing)
+      draw_instanced();
+    else
+      for (i = 0; i < ngears; i++) {
+        glPushMatrix();
+          glTranslatef(gears[i].x, gears[i].y, 0.0);
+          glRotatef(gears[i].speed * angle + gears[i].phase, 0.0, 0.0, 1.0);
+          glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, gears[i].color);
+          gear_draw(&shapes[gears[i].shape].buffer, 0);
+        glPopMatrix();
+      }
 
   glPopMatrix();
+}
+
+/*
+ * Render and finish one benchmark frame, timing the CPU it takes: the
+ * driver's, and with a software GL the rasterizer's too
+ */
+static void
+bench_frame(void)
+{
+  clock_t start;
+
+  if (!bench_times)
+    bench_times = malloc(bench_frames * sizeof(double));
+
+  start = clock();
+  render();
+  glFinish();
+  if (bench_done >= bench_warmup)
+    bench_times[bench_done - bench_warmup] = (double) (clock() - start) / CLOCKS_PER_SEC;
+  bench_done++;
+
+  angle = fmod(angle + BENCH_STEP, 360.0);
+}
+
+static int
+compare_times(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* nearest rank percentile of n sorted times, in milliseconds */
+static double
+percentile(const double *sorted, GLint n, double p)
+{
+  GLint rank = (GLint) ceil(p / 100.0 * n);
+  return 1000 * sorted[rank < 1 ? 0 : rank - 1];
+}
+
+/* frame time statistics as JSON, to -json's file or stdout */
+static void
+bench_report(void)
+{
+  GLint i, n = bench_frames;
+  double sum = 0;
+  const char *c, *renderer = (const char *) glGetString(GL_RENDERER);
+  FILE *out = bench_json ? fopen(bench_json, "w") : stdout;
+
+  if (!out) {
+    fprintf(stderr, "Cannot write %s\n", bench_json);
+    exit(1);
+  }
+
+  qsort(bench_times, n, sizeof(double), compare_times);
+  for (i = 0; i < n; i++)
+    sum += bench_times[i];
+
+  fprintf(out, "{\n  \"renderer\": \"");
+  for (c = renderer ? renderer : ""; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', out);
+    fputc(*c, out);
+  }
+  fprintf(out, "\",\n");
+  fprintf(out, "  \"gears\": %d,\n  \"triangles\": %d,\n  \"instanced\": %s,\n",
+          ngears, scene_triangles, use_instancing ? "true" : "false");
+  fprintf(out, "  \"frames\": %d,\n  \"warmup\": %d,\n  \"step_degrees\": %g,\n",
+          n, bench_warmup, BENCH_STEP);
+  fprintf(out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+          "\"p99\": %.4f, \"max\": %.4f}\n}\n",
+          1000 * sum / n, percentile(bench_times, n, 50), percentile(bench_times, n, 95),
+          percentile(bench_times, n, 99), 1000 * bench_times[n - 1]);
+  if (out != stdout)
+    fclose(out);
+}
+
+#ifndef OSMESA
+static void
+draw(void)
+{
+  if (bench_frames) {
+    bench_frame();
+    glutSwapBuffers();
+    if (bench_done == bench_warmup + bench_frames) {
+      bench_report();
+      cleanup();
+      exit(0);
+    }
+    return;
+  }
+
+  render();
 
   Frames++;
 
@@ -243,7 +734,10 @@ draw(void)
     if (t - T0 >= 5000) {
       GLfloat seconds = (t - T0) / 1000.0;
       fps = Frames / seconds;
-      printf("%d frames in %6.3f seconds = %6.3f FPS\n", Frames, seconds, fps);
+      printf("%d frames in %6.3f seconds = %6.3f FPS", Frames, seconds, fps);
+      if (stress_gears)
+        printf(", %d gears, %.1fM triangles/s", ngears, fps * scene_triangles / 1e6);
+      printf("\n");
       fflush(stdout);
       T0 = t;
       Frames = 0;
@@ -256,7 +750,7 @@ draw(void)
 
   glColor3f(1,1,1);
   glWindowPos2i(5,5);
-  Print("FPS %.3f", fps);
+  Print("FPS %.3f%s", fps, use_instancing ? " instanced" : "");
 
   glutSwapBuffers();
 }
@@ -266,14 +760,26 @@ static void
 idle(void)
 {
   static double t0 = -1.;
-  double dt, t = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
+  double dt, t;
+
+  /* the benchmark steps the animation itself */
+  if (bench_frames) {
+    glutPostRedisplay();
+    return;
+  }
+
+  t = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
   if (t0 < 0.0)
     t0 = t;
   dt = t - t0;
   t0 = t;
 
   angle += 70.0 * dt;  /* 70 degrees per second */
-  angle = fmod(angle, 360.0); /* prevents eventual overflow */
+  /*
+   * prevents eventual overflow; a whole turn of the input moves every
+   * gear a whole number of teeth, so the wrap does not show
+   */
+  angle = fmod(angle, 360.0);
 
   glutPostRedisplay();
 }
@@ -290,6 +796,9 @@ key(unsigned char k, int x, int y)
   case 'Z':
     view_rotz -= 5.0;
     break;
+  case 'i':
+    use_instancing = !use_instancing && instance_program;
+    break;
   case 27:  /* Escape */
     cleanup();
     exit(0);
@@ -323,6 +832,7 @@ special(int k, int x, int y)
   }
   glutPostRedisplay();
 }
+#endif
 
 /* new window size or exposure */
 static void
@@ -339,14 +849,137 @@ reshape(int width, int height)
   glTranslatef(0.0, 0.0, -40.0);
 }
 
+static const GLfloat red[4] = {0.8, 0.1, 0.0, 1.0};
+static const GLfloat green[4] = {0.0, 0.8, 0.2, 1.0};
+static const GLfloat blue[4] = {0.2, 0.2, 1.0, 1.0};
+
+/* the classic three, now meshed by the solver rather than phased by hand */
+static void
+make_gears(void)
+{
+  GLint big = add_shape(1.0, 1.0, 20);
+  GLint wide = add_shape(0.5, 2.0, 10);
+  GLint thin = add_shape(1.3, 0.5, 10);
+
+  add_gear(big, red, -3.0, -2.0, -1);
+  add_gear(wide, green, 3.1, -2.0, 0);
+  add_gear(thin, blue, -3.1, 4.2, 0);
+}
+
+static int
+compare_x(const void *a, const void *b)
+{
+  GLfloat x = gears[*(const GLint *) a].x, y = gears[*(const GLint *) b].x;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Pairs of gears whose teeth reach into each other without meshing,
+ * which a train must never have.  A sweep along x, so only gears
+ * within two tip radii across are compared.
+ */
+static GLint
+train_overlaps(void)
+{
+  GLint *order = malloc(ngears * sizeof(GLint));
+  GLint i, j, overlaps = 0;
+  GLfloat reach = 0;
+
+  for (i = 0; i < nshapes; i++)
+    reach = fmax(reach, 2 * (shapes[i].radius + GEAR_TOOTH_DEPTH / 2));
+  for (i = 0; i < ngears; i++)
+    order[i] = i;
+  qsort(order, ngears, sizeof(GLint), compare_x);
+
+  for (i = 0; i < ngears; i++) {
+    Gear *a = &gears[order[i]];
+    for (j = i + 1; j < ngears && gears[order[j]].x - a->x < reach; j++) {
+      Gear *b = &gears[order[j]];
+      GLfloat tips = shapes[a->shape].radius + shapes[b->shape].radius + GEAR_TOOTH_DEPTH;
+      if (a->driver == order[j] || b->driver == order[i])
+        continue;
+      if ((a->x - b->x) * (a->x - b->x) + (a->y - b->y) * (a->y - b->y) < tips * tips)
+        overlaps++;
+    }
+  }
+  free(order);
+  return overlaps;
+}
+
+/*
+ * A train of count gears, alternately teeth and half as many, snaking
+ * back and forth across rows with one gear between rows to carry the
+ * drive round each bend.  The bend gear sits 60 degrees below the row,
+ * out past its end, so each gear's two neighbours are 120 degrees apart
+ * round it; straight down would put it within tip reach of the gear two
+ * back whenever teeth < 23.  Each gear is solved as it is added.
+ */
+static void
+make_stress_gears(GLint count, GLint teeth)
+{
+  const GLfloat *colors[3] = {red, green, blue};
+  GLint small = teeth / 2 < 6 ? teeth : teeth / 2;
+  GLint side = (GLint) ceil(sqrt(count)), column = 0, bend = 0, i, solved, overlaps;
+  GLint kinds[2];
+  GLfloat direction = 0, xmin, xmax, ymin, ymax;
+  clock_t start;
+  double shaped, built;
+
+  start = clock();
+  kinds[0] = add_shape(0.25 * teeth * GEAR_MODULE, 1.0, teeth);
+  kinds[1] = add_shape(0.25 * small * GEAR_MODULE, 1.0, small);
+  shaped = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  add_gear(kinds[0], red, 0.0, 0.0, -1);
+  for (i = 1; i < count; i++) {
+    if (column < side - 1) {
+      mesh_gear(kinds[i % 2], colors[i % 3], i - 1, direction);
+      column++;
+    }
+    else {
+      /* out and down past the row end, then back in under it */
+      GLfloat out = direction ? 240 : 300;
+      mesh_gear(kinds[i % 2], colors[i % 3], i - 1, bend ? 540 - out : out);
+      if (bend) {
+        column = 0;
+        direction = 180 - direction;
+      }
+      bend = !bend;
+    }
+  }
+  built = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  overlaps = train_overlaps();
+  if (overlaps)
+    fprintf(stderr, "%d pairs of gears overlap without meshing\n", overlaps);
+
+  start = clock();
+  solved = train_solve(0);
+  fprintf(diagnostics(), "%d gears of %d and %d teeth, %d triangles: shapes built in %.2f ms, "
+         "train built and solved gear by gear in %.2f ms, all %d re-solved in %.2f ms\n",
+         count, teeth, small, scene_triangles, 1000 * shaped, 1000 * built,
+         solved, 1000 * (double) (clock() - start) / CLOCKS_PER_SEC);
+
+  /* centre the train and fit it in the roughly 15 unit wide view */
+  xmin = xmax = gears[0].x;
+  ymin = ymax = gears[0].y;
+  for (i = 1; i < ngears; i++) {
+    xmin = fmin(xmin, gears[i].x);
+    xmax = fmax(xmax, gears[i].x);
+    ymin = fmin(ymin, gears[i].y);
+    ymax = fmax(ymax, gears[i].y);
+  }
+  scene_x = (xmin + xmax) / 2;
+  scene_y = (ymin + ymax) / 2;
+  scene_scale = fmin(1.0, 15.0 / (fmax(xmax - xmin, ymax - ymin) + 2 * shapes[kinds[0]].radius));
+}
+
 static void
 init(int argc, char *argv[])
 {
   static GLfloat pos[4] = {5.0, 5.0, 10.0, 0.0};
-  static GLfloat red[4] = {0.8, 0.1, 0.0, 1.0};
-  static GLfloat green[4] = {0.0, 0.8, 0.2, 1.0};
-  static GLfloat blue[4] = {0.2, 0.2, 1.0, 1.0};
-  GLint i;
+  GLint i, info = 0;
 
   glLightfv(GL_LIGHT0, GL_POSITION, pos);
   glEnable(GL_CULL_FACE);
@@ -354,41 +987,60 @@ init(int argc, char *argv[])
   glEnable(GL_LIGHT0);
   glEnable(GL_DEPTH_TEST);
 
-  /* make the gears */
-  gear1 = glGenLists(1);
-  glNewList(gear1, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, red);
-  gear(1.0, 4.0, 1.0, 20, 0.7);
-  glEndList();
-
-  gear2 = glGenLists(1);
-  glNewList(gear2, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, green);
-  gear(0.5, 2.0, 2.0, 10, 0.7);
-  glEndList();
-
-  gear3 = glGenLists(1);
-  glNewList(gear3, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, blue);
-  gear(1.3, 2.0, 0.5, 10, 0.7);
-  glEndList();
-
   glEnable(GL_NORMALIZE);
+  init_instancing();
 
   for ( i=1; i<argc; i++ ) {
     if (strcmp(argv[i], "-info")==0) {
-      printf("GL_RENDERER   = %s\n", (char *) glGetString(GL_RENDERER));
-      printf("GL_VERSION    = %s\n", (char *) glGetString(GL_VERSION));
-      printf("GL_VENDOR     = %s\n", (char *) glGetString(GL_VENDOR));
-      printf("GL_EXTENSIONS = %s\n", (char *) glGetString(GL_EXTENSIONS));
+      info = 1;
     }
     else if ( strcmp(argv[i], "-exit")==0) {
       autoexit = 30;
-      printf("Auto Exit after %i seconds.\n", autoexit );
+    }
+    else if (strcmp(argv[i], "-gears") == 0 && i + 1 < argc) {
+      stress_gears = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-teeth") == 0 && i + 1 < argc) {
+      stress_teeth = atoi(argv[++i]);
+      if (!stress_gears)
+        stress_gears = 1;
+    }
+    else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc) {
+      bench_frames = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc) {
+      bench_warmup = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+      bench_json = argv[++i];
+    }
+    else if (strcmp(argv[i], "-noinstance") == 0) {
+      use_instancing = 0;
     }
   }
+
+  if (bench_frames < 0)
+    bench_frames = 0;
+  if (bench_warmup < 0)
+    bench_warmup = 0;
+
+  /* printed once -bench, wherever it came, has picked the stream */
+  if (info) {
+    fprintf(diagnostics(), "GL_RENDERER   = %s\n", (char *) glGetString(GL_RENDERER));
+    fprintf(diagnostics(), "GL_VERSION    = %s\n", (char *) glGetString(GL_VERSION));
+    fprintf(diagnostics(), "GL_VENDOR     = %s\n", (char *) glGetString(GL_VENDOR));
+    fprintf(diagnostics(), "GL_EXTENSIONS = %s\n", (char *) glGetString(GL_EXTENSIONS));
+  }
+  if (autoexit)
+    fprintf(diagnostics(), "Auto Exit after %i seconds.\n", autoexit );
+
+  if (stress_gears > 0)
+    make_stress_gears(stress_gears, stress_teeth < 6 ? 6 : stress_teeth);
+  else
+    make_gears();
 }
 
+#ifndef OSMESA
 static void 
 visible(int vis)
 {
@@ -424,3 +1076,30 @@ int main(int argc, char *argv[])
   glutMainLoop();
   return 0;             /* ANSI C requires main to return int. */
 }
+#else
+/* offscreen through OSMesa: nothing to show, so just the benchmark */
+int main(int argc, char *argv[])
+{
+  const GLint width = 300, height = 300;
+  GLubyte *buffer = malloc(4 * width * height);
+  OSMesaContext ctx = OSMesaCreateContextExt(OSMESA_RGBA, 16, 0, 0, NULL);
+
+  if (!ctx || !buffer || !OSMesaMakeCurrent(ctx, buffer, GL_UNSIGNED_BYTE, width, height)) {
+    fprintf(stderr, "Error creating OSMesa context\n");
+    exit(1);
+  }
+  init(argc, argv);
+  if (bench_frames <= 0)
+    bench_frames = 300;
+  reshape(width / RES, height / RES);
+
+  while (bench_done < bench_warmup + bench_frames)
+    bench_frame();
+  bench_report();
+
+  cleanup();
+  OSMesaDestroyContext(ctx);
+  free(buffer);
+  return 0;
+}
+#endif
@@ -1,3 +1,4 @@
+#pragma once
 #include <vector>
 #include <initializer_list>
 #include "math.h"
@@ -18,6 +19,24 @@ struct Vec3 {
     float* toArray();
 };
 
+/// @brief Column-major 4x4 matrix laid out like OpenGL's, so it can be
+/// handed to glMultMatrixf directly. Composes on the CPU without a context.
+struct Mat4 {
+    float m[16];
+    static Mat4 identity();
+    static Mat4 translation(Vec3 offset);
+    static Mat4 scaling(Vec3 scale);
+    static Mat4 rotation(float degrees, Vec3 axis);
+    static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar);
+    Mat4 operator*(Mat4 other);
+    Vec3 transformPoint(Vec3 point);
+    Vec3 transformDirection(Vec3 direction);
+    /// @brief Transform a surface normal (inverse transpose), renormalized.
+    Vec3 transformNormal(Vec3 normal);
+};
+
+class RenderBackend;
+
 struct BoundingBox {
     Vec3 min, max;
     Vec3 center();
@@ -28,6 +47,8 @@ struct Drawable {
     virtual void draw() = 0;
     virtual ~Drawable() {};
     virtual BoundingBox bounds() = 0;
+    /// @brief draw() through any backend, GL or not.
+    virtual void render(RenderBackend *backend) = 0;
 };
 
 class Prism;
@@ -47,6 +68,8 @@ struct Polygon : public Drawable {
     Prism* extrude(Vec3 extrusion);
     void draw();
     BoundingBox bounds();
+    void render(RenderBackend *backend);
+    Vec3 getNormal();
     
     private:
         Vec3 normal;
@@ -62,6 +85,7 @@ class Frustum : public Drawable {
         void draw();
         std::vector<Polygon> getPolygons();
         BoundingBox bounds();
+        void render(RenderBackend *backend);
         Box* boxed();
     private:
         std::vector<Polygon> polygons;
@@ -75,7 +99,7 @@ class Prism : public Frustum {
 
 class Box : public Drawable {
     private:
-        float matrix[16];
+        Mat4 matrix;
         Vec3 scaleFactor = {1, 1, 1};
 
     public:
@@ -88,6 +112,7 @@ class Box : public Drawable {
         void identity();
         BoundingBox bounds();
         void draw();
+        void render(RenderBackend *backend);
         Box* scale(Vec3 scale);
         Box* scale(float scale);
         Box* move(Vec3 pos);
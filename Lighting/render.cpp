@@ -0,0 +1,338 @@
+#include "CSCIx229.h"
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include "render.h"
+
+// -------- SoftwareRasterizer -------- //
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, int threads)
+{
+    this->width = width;
+    this->height = height;
+    this->threads = threads > 0 ? threads : 1;
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    bins.resize(tilesX * tilesY);
+    pixels.resize(width * height * 3);
+    depth.resize(width * height);
+    projection = Mat4::identity();
+    stack.push_back(Mat4::identity());
+}
+
+void SoftwareRasterizer::clear(Vec3 color)
+{
+    clearColor = color;
+    triangles.clear();
+    for (auto &bin : bins)
+    {
+        bin.clear();
+    }
+}
+
+void SoftwareRasterizer::loadMatrix(Mat4 matrix)
+{
+    stack.back() = matrix;
+}
+
+Mat4 SoftwareRasterizer::modelview()
+{
+    return stack.back();
+}
+
+void SoftwareRasterizer::pushMatrix()
+{
+    stack.push_back(stack.back());
+}
+
+void SoftwareRasterizer::multMatrix(Mat4 matrix)
+{
+    stack.back() = stack.back() * matrix;
+}
+
+void SoftwareRasterizer::popMatrix()
+{
+    if (stack.size() > 1)
+    {
+        stack.pop_back();
+    }
+}
+
+SoftwareRasterizer::Vertex SoftwareRasterizer::transform(Vec3 position, Vec3 normal, Vec3 color)
+{
+    Mat4 &model = stack.back();
+    Vec3 eye = model.transformPoint(position);
+    float *p = projection.m;
+    float clipX = p[0] * eye.x + p[4] * eye.y + p[8] * eye.z + p[12];
+    float clipY = p[1] * eye.x + p[5] * eye.y + p[9] * eye.z + p[13];
+    float clipZ = p[2] * eye.x + p[6] * eye.y + p[10] * eye.z + p[14];
+    float clipW = p[3] * eye.x + p[7] * eye.y + p[11] * eye.z + p[15];
+
+    Vertex vertex;
+    vertex.clipX = clipX;
+    vertex.clipY = clipY;
+    vertex.clipZ = clipZ;
+    vertex.clipW = clipW;
+    vertex.eye = eye;
+    vertex.normal = model.transformNormal(normal);
+    vertex.color = color;
+    project(vertex);
+    return vertex;
+}
+
+void SoftwareRasterizer::project(Vertex &vertex)
+{
+    vertex.invW = vertex.clipW > 0 ? 1 / vertex.clipW : 0;
+    vertex.x = (vertex.clipX * vertex.invW + 1) * .5f * width;
+    vertex.y = (vertex.clipY * vertex.invW + 1) * .5f * height;
+    vertex.z = vertex.clipZ * vertex.invW;
+}
+
+SoftwareRasterizer::Vertex SoftwareRasterizer::lerp(Vertex &a, Vertex &b, float t)
+{
+    Vertex vertex;
+    vertex.clipX = a.clipX + (b.clipX - a.clipX) * t;
+    vertex.clipY = a.clipY + (b.clipY - a.clipY) * t;
+    vertex.clipZ = a.clipZ + (b.clipZ - a.clipZ) * t;
+    vertex.clipW = a.clipW + (b.clipW - a.clipW) * t;
+    vertex.eye = a.eye + (b.eye - a.eye) * t;
+    vertex.normal = a.normal + (b.normal - a.normal) * t;
+    vertex.color = a.color + (b.color - a.color) * t;
+    return vertex;
+}
+
+void SoftwareRasterizer::addTriangle(Vertex &a, Vertex &b, Vertex &c)
+{
+    // distance inside the near plane, z >= -w, as GL clips before the divide
+    float da = a.clipZ + a.clipW, db = b.clipZ + b.clipW, dc = c.clipZ + c.clipW;
+    if (da >= 0 && db >= 0 && dc >= 0)
+    {
+        addProjected(a, b, c);
+        return;
+    }
+    if (da < 0 && db < 0 && dc < 0)
+    {
+        return;
+    }
+
+    // one or two corners are behind it: walk the edges keeping the inside
+    // corners and adding a corner wherever an edge crosses, then fan the
+    // triangle or quad that is left, which keeps the winding
+    Vertex *in[3] = {&a, &b, &c};
+    float d[3] = {da, db, dc};
+    Vertex out[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        if (d[i] >= 0)
+        {
+            out[count++] = *in[i];
+        }
+        if ((d[i] >= 0) != (d[j] >= 0))
+        {
+            out[count] = lerp(*in[i], *in[j], d[i] / (d[i] - d[j]));
+            project(out[count++]);
+        }
+    }
+    for (int i = 2; i < count; i++)
+    {
+        addProjected(out[0], out[i - 1], out[i]);
+    }
+}
+
+void SoftwareRasterizer::addProjected(Vertex &a, Vertex &b, Vertex &c)
+{
+    // on the near plane itself w can still be 0 for a projection with no
+    // near distance, and those corners have no window position
+    if (a.invW == 0 || b.invW == 0 || c.invW == 0)
+    {
+        return;
+    }
+
+    // cull back faces, front faces wind counter clockwise in window space
+    float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    if (area <= 0)
+    {
+        return;
+    }
+
+    float minX = std::min({a.x, b.x, c.x}), maxX = std::max({a.x, b.x, c.x});
+    float minY = std::min({a.y, b.y, c.y}), maxY = std::max({a.y, b.y, c.y});
+    if (maxX < 0 || maxY < 0 || minX >= width || minY >= height)
+    {
+        return;
+    }
+
+    int index = triangles.size();
+    triangles.push_back({{a, b, c}});
+
+    int tx0 = std::max(0, (int)minX / tileSize), tx1 = std::min(tilesX - 1, (int)maxX / tileSize);
+    int ty0 = std::max(0, (int)minY / tileSize), ty1 = std::min(tilesY - 1, (int)maxY / tileSize);
+    for (int ty = ty0; ty <= ty1; ty++)
+    {
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            bins[ty * tilesX + tx].push_back(index);
+        }
+    }
+}
+
+void SoftwareRasterizer::drawPolygon(Polygon &polygon)
+{
+    auto &verticies = polygon.verticies;
+    if (verticies.size() < 3)
+    {
+        return;
+    }
+
+    Vec3 normal = polygon.getNormal();
+    Vertex first = transform(verticies[0], normal, polygon.color);
+    Vertex previous = transform(verticies[1], normal, polygon.color);
+    for (unsigned int i = 2; i < verticies.size(); i++)
+    {
+        Vertex next = transform(verticies[i], normal, polygon.color);
+        addTriangle(first, previous, next);
+        previous = next;
+    }
+}
+
+/// @brief pixlight.frag on the CPU
+Vec3 SoftwareRasterizer::shade(Vec3 eye, Vec3 normal, Vec3 color)
+{
+    Vec3 N = normal.normalized();
+    Vec3 L = (light.position - eye).normalized();
+    Vec3 V = (eye * -1).normalized();
+
+    float Id = std::max(L.x * N.x + L.y * N.y + L.z * N.z, 0.0f);
+    float Is = 0;
+    if (Id > 0)
+    {
+        Vec3 R = N * (2 * Id) - L;
+        Is = powf(std::max(R.x * V.x + R.y * V.y + R.z * V.z, 0.0f), light.shininess);
+    }
+
+    return light.emission
+         + color.multComps(light.ambient)
+         + color.multComps(light.diffuse) * Id
+         + light.specular.multComps(light.materialSpecular) * Is;
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile)
+{
+    int x0 = (tile % tilesX) * tileSize, x1 = std::min(x0 + tileSize, width);
+    int y0 = (tile / tilesX) * tileSize, y1 = std::min(y0 + tileSize, height);
+
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            int i = y * width + x;
+            depth[i] = 1;
+            pixels[i * 3 + 0] = (unsigned char)(std::min(std::max(clearColor.x, 0.0f), 1.0f) * 255 + .5f);
+            pixels[i * 3 + 1] = (unsigned char)(std::min(std::max(clearColor.y, 0.0f), 1.0f) * 255 + .5f);
+            pixels[i * 3 + 2] = (unsigned char)(std::min(std::max(clearColor.z, 0.0f), 1.0f) * 255 + .5f);
+        }
+    }
+
+    for (int index : bins[tile])
+    {
+        Vertex *v = triangles[index].v;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+
+        int minX = std::max(x0, (int)floorf(std::min({v[0].x, v[1].x, v[2].x})));
+        int maxX = std::min(x1 - 1, (int)ceilf(std::max({v[0].x, v[1].x, v[2].x})));
+        int minY = std::max(y0, (int)floorf(std::min({v[0].y, v[1].y, v[2].y})));
+        int maxY = std::min(y1 - 1, (int)ceilf(std::max({v[0].y, v[1].y, v[2].y})));
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + .5f;
+            for (int x = minX; x <= maxX; x++)
+            {
+                float px = x + .5f;
+                // edge functions, weight of the vertex opposite each edge
+                float w0 = (v[2].x - v[1].x) * (py - v[1].y) - (v[2].y - v[1].y) * (px - v[1].x);
+                float w1 = (v[0].x - v[2].x) * (py - v[2].y) - (v[0].y - v[2].y) * (px - v[2].x);
+                float w2 = (v[1].x - v[0].x) * (py - v[0].y) - (v[1].y - v[0].y) * (px - v[0].x);
+                if (w0 < 0 || w1 < 0 || w2 < 0)
+                {
+                    continue;
+                }
+                w0 /= area;
+                w1 /= area;
+                w2 /= area;
+
+                // depth is linear in window space, and clipped to the near and far planes
+                float z = w0 * v[0].z + w1 * v[1].z + w2 * v[2].z;
+                int i = y * width + x;
+                if (z < -1 || z > 1 || (z + 1) * .5f >= depth[i])
+                {
+                    continue;
+                }
+                depth[i] = (z + 1) * .5f;
+
+                // everything else is perspective correct
+                float p0 = w0 * v[0].invW, p1 = w1 * v[1].invW, p2 = w2 * v[2].invW;
+                float sum = p0 + p1 + p2;
+                p0 /= sum;
+                p1 /= sum;
+                p2 /= sum;
+
+                Vec3 eye = v[0].eye * p0 + v[1].eye * p1 + v[2].eye * p2;
+                Vec3 normal = v[0].normal * p0 + v[1].normal * p1 + v[2].normal * p2;
+                Vec3 color = v[0].color * p0 + v[1].color * p1 + v[2].color * p2;
+                Vec3 lit = shade(eye, normal, color);
+
+                pixels[i * 3 + 0] = (unsigned char)(std::min(std::max(lit.x, 0.0f), 1.0f) * 255 + .5f);
+                pixels[i * 3 + 1] = (unsigned char)(std::min(std::max(lit.y, 0.0f), 1.0f) * 255 + .5f);
+                pixels[i * 3 + 2] = (unsigned char)(std::min(std::max(lit.z, 0.0f), 1.0f) * 255 + .5f);
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::finish()
+{
+    std::atomic<int> next(0);
+    int tiles = tilesX * tilesY;
+    auto work = [&]() {
+        for (int tile = next++; tile < tiles; tile = next++)
+        {
+            rasterizeTile(tile);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(std::thread(work));
+    }
+    work();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+bool SoftwareRasterizer::writePPM(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    // PPM stores the top row first
+    for (int y = height - 1; y >= 0; y--)
+    {
+        fwrite(&pixels[y * width * 3], 1, width * 3, file);
+    }
+    return fclose(file) == 0;
+}
+
+int SoftwareRasterizer::triangleCount()
+{
+    return triangles.size();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include "geometry.h"
+
+/// @brief Where Drawable::render() sends geometry, so the scene can be drawn
+/// by a CPU rasterizer that needs no context.
+class RenderBackend {
+    public:
+        virtual ~RenderBackend() {}
+        virtual void pushMatrix() = 0;
+        virtual void multMatrix(Mat4 matrix) = 0;
+        virtual void popMatrix() = 0;
+        virtual void drawPolygon(Polygon &polygon) = 0;
+};
+
+/// @brief Light 0 and material as pixlight.frag sees them. The position is
+/// in eye space, like GL_POSITION after the modelview transform.
+struct SoftwareLight {
+    Vec3 position = {0, 0, 1};
+    Vec3 ambient = {0, 0, 0};
+    Vec3 diffuse = {1, 1, 1};
+    Vec3 specular = {1, 1, 1};
+    // GL's default material has no specular, and GL_COLOR_MATERIAL leaves it alone
+    Vec3 materialSpecular = {0, 0, 0};
+    Vec3 emission = {0, 0, 0};
+    float shininess = 16;
+};
+
+/// @brief CPU rasterizer following the GL pipeline the scenes use: depth test
+/// with GL_LESS, back faces culled with CCW fronts, and per pixel lighting
+/// from pixlight.frag. Triangles are binned into screen tiles and the tiles
+/// shaded in parallel, each in submission order, so output does not depend
+/// on the thread count.
+class SoftwareRasterizer : public RenderBackend {
+    public:
+        static const int tileSize = 64;
+
+        int width, height;
+        Mat4 projection;
+        SoftwareLight light;
+        // RGB, bottom row first like glReadPixels
+        std::vector<unsigned char> pixels;
+        std::vector<float> depth;
+
+        SoftwareRasterizer(int width, int height, int threads = std::thread::hardware_concurrency());
+
+        void clear(Vec3 color);
+        void loadMatrix(Mat4 matrix);
+        Mat4 modelview();
+        void pushMatrix();
+        void multMatrix(Mat4 matrix);
+        void popMatrix();
+        void drawPolygon(Polygon &polygon);
+        /// @brief Rasterize everything drawn since clear() into pixels.
+        void finish();
+        /// @brief Write pixels as a binary PPM. Returns false on failure.
+        bool writePPM(const char *path);
+        int triangleCount();
+
+    private:
+        struct Vertex {
+            // clip space position
+            float clipX, clipY, clipZ, clipW;
+            // window x, y and NDC z, then 1 / clip w, once projected
+            float x, y, z, invW;
+            Vec3 eye, normal, color;
+        };
+        struct Triangle {
+            Vertex v[3];
+        };
+
+        int threads;
+        int tilesX, tilesY;
+        std::vector<Mat4> stack;
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<int>> bins;
+        Vec3 clearColor = {0, 0, 0};
+
+        Vertex transform(Vec3 position, Vec3 normal, Vec3 color);
+        void project(Vertex &vertex);
+        /// @brief Point t of the way from a to b, in clip space where every
+        /// attribute is still linear.
+        static Vertex lerp(Vertex &a, Vertex &b, float t);
+        /// @brief Clip against the near plane, then bin what is left.
+        void addTriangle(Vertex &a, Vertex &b, Vertex &c);
+        void addProjected(Vertex &a, Vertex &b, Vertex &c);
+        void rasterizeTile(int tile);
+        Vec3 shade(Vec3 eye, Vec3 normal, Vec3 color);
+};
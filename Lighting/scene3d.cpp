@@ -1,7 +1,10 @@
 #include "CSCIx229.h"
+#include <chrono>
 
 #include "models/buff.h"
 #include "loadShader.h"
+#include "appLoop.h"
+#include "render.h"
 
 struct OrbitParams
 {
@@ -35,6 +38,9 @@ struct LightParams {
 } light;
 
 Box *scene;
+Vec3 background;
+int headlessFrames = 0;
+const char *headlessImage = "headless.ppm";
 
 #define LEN 8192 //  Maximum length of text string
 void Print(const char *format, ...)
@@ -98,17 +104,15 @@ void draw()
    glFlush();
 }
 
-// -------- Idle Hook -------- //
-void idle()
+// -------- Animation Hook -------- //
+void orbitLight(double t)
 {
    // -------------- Handle orbitting light source
-   float dt = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
-   light.pos.x = light.radius * cos(dt * light.speed);
-   light.pos.z = light.radius * sin(dt * light.speed);
+   light.pos.x = light.radius * cos(t * light.speed);
+   light.pos.z = light.radius * sin(t * light.speed);
    int directional = !light.directional ? 1 : 0;
    const float pos[] = {light.pos.x, light.pos.y, light.pos.z, (float) directional};
    glLightfv(GL_LIGHT0, GL_POSITION, pos);
-   glutPostRedisplay();
 }
 
 // -------- Window Reshape -------- //
@@ -132,6 +136,9 @@ void reshape(int width, int height)
 
 void key(unsigned char ch, int x, int y)
 {
+   // space stops and starts the light
+   if (ch == ' ')
+      appLoopAnimate(!appLoop.animating);
 }
 
 // -------- Special -------- //
@@ -165,22 +172,11 @@ void special(int key, int x, int y)
    glutPostRedisplay();
 }
 
-// -------- Visibility -------- //
-void visible(int vis)
-{
-   if (vis == GLUT_VISIBLE)
-      glutIdleFunc(idle);
-   else
-      glutIdleFunc(NULL);
-}
-
 void initScene()
 {
    auto theme = Vec3{.4, .5, 1}.normalized();
-   auto bgColor = theme * .2;
+   background = theme * .2;
    auto floorColor = theme * .8; 
-   
-   glClearColor(bgColor.x, bgColor.y, bgColor.z, 1);
 
    auto mainBuff = buildBuff()
                        ->rotate({0, (float)(rand() % 360), 0});
@@ -244,8 +240,66 @@ void initLighting() {
    glUseProgram(shader1);
 }
 
+// -------- Headless -------- //
+/// @brief Time the lit scene through the software rasterizer frame by frame
+/// as the point light circles it, and write where the light ended up in the
+/// last frame. The light's marker sphere and the axes are left out.
+int renderHeadless(int frames, const char *path)
+{
+   const int size = 600;
+   SoftwareRasterizer raster(size, size);
+   const float dim = orbit.dim;
+   raster.projection = Mat4::orthographic(-dim, dim, -dim, dim, -dim, dim * 2);
+   raster.light.ambient = light.color * light.ambient;
+   raster.light.diffuse = light.color * light.diffuse;
+   raster.light.specular = light.color * light.specular;
+   raster.light.shininess = light.shininess;
+
+   auto view = Mat4::rotation(orbit.pitch, {1, 0, 0}) * Mat4::rotation(orbit.yaw, {0, 1, 0});
+   auto start = std::chrono::steady_clock::now();
+   for (int frame = 0; frame < frames; frame++)
+   {
+      // the same orbit orbitLight() takes, a frame per appLoop tick
+      float t = frame / (double) appLoop.fps;
+      light.pos.x = light.radius * cos(t * light.speed);
+      light.pos.z = light.radius * sin(t * light.speed);
+      raster.light.position = light.directional ? view.transformDirection(light.pos) : view.transformPoint(light.pos);
+
+      raster.clear(background);
+      raster.loadMatrix(view);
+      scene->render(&raster);
+      raster.finish();
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   printf("Rendered %d frames of %d triangles at %dx%d in %.2f s (%.1f FPS)\n",
+          frames, raster.triangleCount(), size, size, elapsed.count(), frames / elapsed.count());
+   if (!raster.writePPM(path))
+   {
+      fprintf(stderr, "Could not write %s\n", path);
+      return 1;
+   }
+   printf("Wrote %s\n", path);
+   return 0;
+}
+
 int main(int argc, char *argv[])
 {
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+         headlessFrames = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-ppm") == 0 && i + 1 < argc)
+         headlessImage = argv[i + 1];
+   }
+
+   // -headless lights and renders on the CPU, before GLUT is touched
+   if (headlessFrames > 0)
+   {
+      initScene();
+      return renderHeadless(headlessFrames, headlessImage);
+   }
+
    //  Initialize GLUT and process user parameters
    glutInit(&argc, argv);
 
@@ -277,12 +331,14 @@ int main(int argc, char *argv[])
 
    initScene();
    initLighting();
+   glClearColor(background.x, background.y, background.z, 1);
 
    glutDisplayFunc(draw);
    glutReshapeFunc(reshape);
    glutKeyboardFunc(key);
    glutSpecialFunc(special);
-   glutVisibilityFunc(visible);
+   // the light orbits at up to 60 frames per second
+   appLoopInit(orbitLight);
 
    glutMainLoop();
    return 0; /* ANSI C requires main to return int. */
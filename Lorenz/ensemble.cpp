@@ -0,0 +1,199 @@
+/*
+ * Many trajectories at once, to show sensitivity to initial conditions.
+ * Particles are stored as a structure of arrays and stepped with the same
+ * Euler update as the trail, 8 or 4 at a time with AVX or SSE when the
+ * CPU has them. Drawn as a point cloud colored by velocity.
+ */
+
+#include <vector>
+#include <chrono>
+
+struct ensemble {
+   int count = 0;
+   std::vector<float> x, y, z, velocity;
+   // running velocity range, for coloring
+   float vMin = 500000;
+   float vMax = 0;
+
+   unsigned int buffer = 0;
+   int program = 0;
+   int attributes[4] = {-1, -1, -1, -1};
+};
+
+enum ensembleKernel {
+   ENSEMBLE_SCALAR,
+   ENSEMBLE_SSE,
+   ENSEMBLE_AVX,
+};
+
+const char *ensembleKernelNames[] = {"scalar", "SSE", "AVX"};
+
+/*
+ * Seed count particles uniformly in a ball around center
+ */
+void ensembleSeed(ensemble &e, int count, lorenzPoint center, float radius) {
+   e.count = count;
+   e.x.resize(count);
+   e.y.resize(count);
+   e.z.resize(count);
+   e.velocity.assign(count, 0);
+   e.vMin = 500000;
+   e.vMax = 0;
+
+   srand(1);
+   for (int i = 0; i < count; i++) {
+      float dx, dy, dz;
+      do {
+         dx = 2 * rand() / (float)RAND_MAX - 1;
+         dy = 2 * rand() / (float)RAND_MAX - 1;
+         dz = 2 * rand() / (float)RAND_MAX - 1;
+      } while (dx*dx + dy*dy + dz*dz > 1);
+
+      e.x[i] = center.x + radius * dx;
+      e.y[i] = center.y + radius * dy;
+      e.z[i] = center.z + radius * dz;
+   }
+}
+
+// Particles [first, last) through steps of eulerStep, one at a time
+template <class System>
+static void ensembleStepScalar(ensemble &e, int first, int last, long steps, float dt, const float k[]) {
+   for (int i = first; i < last; i++) {
+      float p[3] = {e.x[i], e.y[i], e.z[i]};
+      float v = e.velocity[i];
+      for (long step = 0; step < steps; step++) {
+         eulerStep<System>(p, v, dt, k);
+      }
+      e.x[i] = p[0];
+      e.y[i] = p[1];
+      e.z[i] = p[2];
+      e.velocity[i] = v;
+   }
+}
+
+#ifdef SIMD_X86
+/*
+ * The same eulerStep on width particles per register. Same operations in
+ * the same order as the scalar loop, so results match it bit for bit.
+ * Returns how many particles were covered.
+ */
+template <class System, class V, int width, V load(const float *), void store(float *, V)>
+inline int ensembleStepLanes(ensemble &e, long steps, float dt, const float k[]) {
+   int i = 0;
+   for (; i + width <= e.count; i += width) {
+      V p[3] = {load(&e.x[i]), load(&e.y[i]), load(&e.z[i])};
+      V v = load(&e.velocity[i]);
+      for (long step = 0; step < steps; step++) {
+         eulerStep<System>(p, v, dt, k);
+      }
+      store(&e.x[i], p[0]);
+      store(&e.y[i], p[1]);
+      store(&e.z[i], p[2]);
+      store(&e.velocity[i], v);
+   }
+   return i;
+}
+
+// flatten pulls the system's equations and every operator into the
+// kernel, which also keeps AVX values from crossing non-AVX calls
+template <class System>
+__attribute__((flatten)) static int ensembleStepSSE(ensemble &e, long steps, float dt, const float k[]) {
+   return ensembleStepLanes<System, float4, 4, load4, store4>(e, steps, dt, k);
+}
+
+template <class System>
+SIMD_AVX __attribute__((flatten)) static int ensembleStepAVX(ensemble &e, long steps, float dt, const float k[]) {
+   return ensembleStepLanes<System, float8, 8, load8, store8>(e, steps, dt, k);
+}
+#endif
+
+// Widest kernel this CPU can run
+ensembleKernel ensembleBestKernel() {
+#ifdef SIMD_X86
+   if (__builtin_cpu_supports("avx")) return ENSEMBLE_AVX;
+   if (__builtin_cpu_supports("sse")) return ENSEMBLE_SSE;
+#endif
+   return ENSEMBLE_SCALAR;
+}
+
+template <class System>
+static void ensembleRun(ensemble &e, ensembleKernel kernel, long steps, float dt, const float k[]) {
+   int done = 0;
+#ifdef SIMD_X86
+   if (kernel == ENSEMBLE_AVX) done = ensembleStepAVX<System>(e, steps, dt, k);
+   else if (kernel == ENSEMBLE_SSE) done = ensembleStepSSE<System>(e, steps, dt, k);
+#endif
+   // the tail, or everything without SIMD
+   ensembleStepScalar<System>(e, done, e.count, steps, dt, k);
+}
+
+/*
+ * Advance every particle of system by steps. Each vector of particles
+ * runs all its steps in registers before the next is loaded.
+ */
+void ensembleStep(ensemble &e, ensembleKernel kernel, attractorKind system, long steps, float dt, const float k[]) {
+   switch (system) {
+      case ROSSLER:
+         ensembleRun<rosslerSystem>(e, kernel, steps, dt, k);
+         break;
+      case THOMAS:
+         ensembleRun<thomasSystem>(e, kernel, steps, dt, k);
+         break;
+      case AIZAWA:
+         ensembleRun<aizawaSystem>(e, kernel, steps, dt, k);
+         break;
+      default:
+         ensembleRun<lorenzSystem>(e, kernel, steps, dt, k);
+   }
+
+   for (int i = 0; i < e.count; i++) {
+      e.vMin = fminf(e.vMin, e.velocity[i]);
+      e.vMax = fmaxf(e.vMax, e.velocity[i]);
+   }
+}
+
+// -------- Drawing -------- //
+
+void ensembleInit(ensemble &e) {
+   glGenBuffers(1, &e.buffer);
+   e.program = CreateShaderProg("ensemble.vert", NULL);
+   // something must sit in attribute 0 for compatibility profile drawing
+   glBindAttribLocation(e.program, 0, "X");
+   glLinkProgram(e.program);
+   const char *names[] = {"X", "Y", "Z", "Velocity"};
+   for (int i = 0; i < 4; i++) {
+      e.attributes[i] = glGetAttribLocation(e.program, names[i]);
+   }
+}
+
+/*
+ * Every particle moves each frame, so the arrays are uploaded whole,
+ * straight from their structure of arrays layout
+ */
+void ensembleDraw(ensemble &e) {
+   if (!e.count) return;
+
+   size_t bytes = e.count * sizeof(float);
+   std::vector<float> *arrays[] = {&e.x, &e.y, &e.z, &e.velocity};
+   glBindBuffer(GL_ARRAY_BUFFER, e.buffer);
+   glBufferData(GL_ARRAY_BUFFER, 4 * bytes, NULL, GL_STREAM_DRAW);
+   for (int i = 0; i < 4; i++) {
+      glBufferSubData(GL_ARRAY_BUFFER, i * bytes, bytes, arrays[i]->data());
+   }
+
+   glUseProgram(e.program);
+   glUniform1f(glGetUniformLocation(e.program, "vMin"), e.vMin);
+   glUniform1f(glGetUniformLocation(e.program, "vMax"), e.vMax);
+   for (int i = 0; i < 4; i++) {
+      glEnableVertexAttribArray(e.attributes[i]);
+      glVertexAttribPointer(e.attributes[i], 1, GL_FLOAT, GL_FALSE, 0, (void *)(i * bytes));
+   }
+
+   glDrawArrays(GL_POINTS, 0, e.count);
+
+   for (int i = 0; i < 4; i++) {
+      glDisableVertexAttribArray(e.attributes[i]);
+   }
+   glUseProgram(0);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
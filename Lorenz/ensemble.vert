@@ -0,0 +1,21 @@
+//  Ensemble point cloud shader
+#version 120
+
+//  Range of velocities seen so far
+uniform float vMin;
+uniform float vMax;
+//  Particle position and velocity, each from its own array
+attribute float X;
+attribute float Y;
+attribute float Z;
+attribute float Velocity;
+
+void main()
+{
+   //  Same colormap as velocity.vert
+   float t = (vMax > vMin) ? (Velocity - vMin) / (vMax - vMin) : 0.0;
+   float h = mod(t * 6.0, 6.0);
+   vec3 rgb = clamp(abs(mod(h + vec3(0.0, 4.0, 2.0), 6.0) - 3.0) - 1.0, 0.0, 1.0);
+   gl_FrontColor = vec4(rgb, 1.0);
+   gl_Position = gl_ModelViewProjectionMatrix * vec4(X, Y, Z, 1.0);
+}
@@ -0,0 +1,259 @@
+/*
+ * Fixed step integration of any system in systems.cpp, decoupled from
+ * frame rate.
+ * Wall time is converted to simulation time and banked in an accumulator,
+ * which is spent in whole steps. The same simulation time always yields
+ * the same points, however it is sliced into frames.
+ */
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+enum integratorMethod {
+   EULER,
+   RK4,
+   // adaptive Runge-Kutta-Fehlberg 4(5), substeps within each fixed step
+   RK45,
+};
+
+const char *integratorNames[] = {"Euler", "RK4", "RK45"};
+
+/*
+ * Precision policies: the type a trajectory is stored in between steps
+ * and the type each step computes in
+ */
+template <class Storage, class Compute>
+struct precisionPolicy {
+   typedef Storage storage;
+   typedef Compute compute;
+};
+
+typedef precisionPolicy<float, float> floatPrecision;
+typedef precisionPolicy<double, double> doublePrecision;
+// rounded to float between steps, as the ring does, with double arithmetic within one
+typedef precisionPolicy<float, double> mixedPrecision;
+
+enum precisionMode {
+   FLOAT_PRECISION,
+   DOUBLE_PRECISION,
+   MIXED_PRECISION,
+};
+
+const char *precisionNames[] = {"float", "double", "float/double"};
+
+struct integrator {
+   integratorMethod method = EULER;
+   // simulation time between points
+   double step = .003;
+   double accumulator = 0;
+   // most steps per advance, so a stall cannot snowball into longer stalls;
+   // integratorBudget() fits it to a frame, this is the ceiling
+   int maxBatch = 1 << 20;
+   // error allowed per RK45 substep
+   float tolerance = 1e-5;
+   precisionMode precision = FLOAT_PRECISION;
+   // the newest point at full storage precision, for when that is more than
+   // the float ring keeps; valid while the ring's total is carriedAt
+   double carry[3];
+   long carriedAt = -1;
+
+   // throughput of the most recent advance
+   long lastSteps = 0;
+   double lastSeconds = 0;
+};
+
+/*
+ * Every step below is written once for any number type T, which is where
+ * the precision policy below comes in. Each advances p in place and
+ * returns the squared speed at the start of the step, as marchPoint does.
+ */
+
+template <class System, class T>
+T rk4Step(T p[3], T dt, const float k[]) {
+   T k1[3], k2[3], k3[3], k4[3], t[3];
+
+   System::derivative(p, k, k1);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + dt/2*k1[i];
+   System::derivative(t, k, k2);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + dt/2*k2[i];
+   System::derivative(t, k, k3);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + dt*k3[i];
+   System::derivative(t, k, k4);
+
+   for (int i = 0; i < 3; i++) p[i] += dt/6*(k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+   return k1[0]*k1[0] + k1[1]*k1[1] + k1[2]*k1[2];
+}
+
+/*
+ * One Fehlberg step of size h. Writes the 5th order solution to out and
+ * returns the largest difference from the embedded 4th order one.
+ */
+template <class System, class T>
+T rkf45Step(const T p[3], T h, const float k[], T out[3]) {
+   T k1[3], k2[3], k3[3], k4[3], k5[3], k6[3], t[3];
+   System::derivative(p, k, k1);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + h*(k1[i]/4);
+   System::derivative(t, k, k2);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + h*(3*k1[i]/32 + 9*k2[i]/32);
+   System::derivative(t, k, k3);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + h*(1932*k1[i]/2197 - 7200*k2[i]/2197 + 7296*k3[i]/2197);
+   System::derivative(t, k, k4);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + h*(439*k1[i]/216 - 8*k2[i] + 3680*k3[i]/513 - 845*k4[i]/4104);
+   System::derivative(t, k, k5);
+   for (int i = 0; i < 3; i++) t[i] = p[i] + h*(-8*k1[i]/27 + 2*k2[i] - 3544*k3[i]/2565 + 1859*k4[i]/4104 - 11*k5[i]/40);
+   System::derivative(t, k, k6);
+
+   T error = 0;
+   for (int i = 0; i < 3; i++) {
+      out[i] = p[i] + h*(16*k1[i]/135 + 6656*k3[i]/12825 + 28561*k4[i]/56430 - 9*k5[i]/50 + 2*k6[i]/55);
+      T fourth = p[i] + h*(25*k1[i]/216 + 1408*k3[i]/2565 + 2197*k4[i]/4104 - k5[i]/5);
+      error = std::max(error, std::abs(out[i] - fourth));
+   }
+   return error;
+}
+
+/*
+ * Cover dt with as many adaptive substeps as the tolerance needs. Substep
+ * sizes restart from dt every call, so the result depends only on the point.
+ */
+template <class System, class T>
+T rk45Step(T p[3], T dt, T tolerance, const float k[]) {
+   T d[3];
+   System::derivative(p, k, d);
+
+   T covered = 0;
+   T h = dt;
+   while (covered < dt) {
+      h = std::min(h, dt - covered);
+      T next[3];
+      T error = rkf45Step<System>(p, h, k, next);
+
+      // accept, or retry smaller; the usual safety factor and growth limits
+      T scale = error > 0 ? T(.9f) * std::pow(tolerance / error, T(.2f)) : 4;
+      if (error <= tolerance || h < dt * T(1e-4f)) {
+         covered += h;
+         for (int i = 0; i < 3; i++) p[i] = next[i];
+      }
+      h *= std::min(std::max(scale, T(.2f)), T(4));
+   }
+
+   return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+}
+
+template <class System, class T>
+T integratorStep(integrator &integ, T p[3], const float k[]) {
+   T dt = integ.step;
+   T velocity;
+   switch (integ.method) {
+      case RK4:
+         return rk4Step<System>(p, dt, k);
+      case RK45:
+         return rk45Step<System>(p, dt, T(integ.tolerance), k);
+      default:
+         eulerStep<System>(p, velocity, integ.step, k);
+         return velocity;
+   }
+}
+
+/*
+ * Bank simTime and withdraw it as whole steps. Returns how many to take.
+ */
+long integratorTake(integrator &integ, double simTime) {
+   integ.accumulator += simTime;
+   long steps = (long)(integ.accumulator / integ.step);
+   if (steps > integ.maxBatch) {
+      // too far behind to catch up, drop the backlog rather than stall
+      steps = integ.maxBatch;
+      integ.accumulator = steps * integ.step;
+   }
+   integ.accumulator -= steps * integ.step;
+   return steps;
+}
+
+template <class System, class Precision>
+static void integratorRun(integrator &integ, long steps, pointRing &points, const float k[]) {
+   typedef typename Precision::storage storage;
+   typedef typename Precision::compute compute;
+
+   storage state[3];
+   lorenzPoint back = ringBack(points);
+   if (integ.carriedAt == points.total) {
+      for (int i = 0; i < 3; i++) state[i] = integ.carry[i];
+   } else {
+      state[0] = back.x;
+      state[1] = back.y;
+      state[2] = back.z;
+   }
+
+   for (long i = 0; i < steps; i++) {
+      compute p[3] = {state[0], state[1], state[2]};
+      compute velocity = integratorStep<System>(integ, p, k);
+      for (int j = 0; j < 3; j++) state[j] = p[j];
+      ringPush(points, lorenzPoint {(float)state[0], (float)state[1], (float)state[2], (float)velocity});
+   }
+
+   for (int i = 0; i < 3; i++) integ.carry[i] = state[i];
+   integ.carriedAt = points.total;
+}
+
+template <class System>
+static void integratorRunAs(integrator &integ, long steps, pointRing &points, const float k[]) {
+   switch (integ.precision) {
+      case DOUBLE_PRECISION:
+         integratorRun<System, doublePrecision>(integ, steps, points, k);
+         break;
+      case MIXED_PRECISION:
+         integratorRun<System, mixedPrecision>(integ, steps, points, k);
+         break;
+      default:
+         integratorRun<System, floatPrecision>(integ, steps, points, k);
+   }
+}
+
+/*
+ * Bank simTime and append one point per whole step of system to points.
+ * Returns the number of points added.
+ */
+int integratorAdvance(integrator &integ, double simTime, pointRing &points, attractorKind system, const float k[]) {
+   long steps = integratorTake(integ, simTime);
+
+   auto start = std::chrono::steady_clock::now();
+   // pick the system and precision once, outside the loop
+   switch (system) {
+      case ROSSLER:
+         integratorRunAs<rosslerSystem>(integ, steps, points, k);
+         break;
+      case THOMAS:
+         integratorRunAs<thomasSystem>(integ, steps, points, k);
+         break;
+      case AIZAWA:
+         integratorRunAs<aizawaSystem>(integ, steps, points, k);
+         break;
+      default:
+         integratorRunAs<lorenzSystem>(integ, steps, points, k);
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   integ.lastSteps = steps;
+   integ.lastSeconds = elapsed.count();
+   return steps;
+}
+
+// steps per second the most recent advance ran at
+double integratorThroughput(integrator &integ) {
+   return integ.lastSeconds > 0 ? integ.lastSteps / integ.lastSeconds : 0;
+}
+
+/*
+ * Cap the next advance at what the last one's throughput gets through in
+ * seconds of wall time, so a backlog costs one frame its budget rather
+ * than a stall. units is what throughput counts per step, the particle
+ * count for an ensemble. Keeps the cap until something has been measured.
+ */
+void integratorBudget(integrator &integ, double seconds, long units = 1) {
+   double rate = integratorThroughput(integ);
+   if (rate <= 0 || units <= 0) return;
+   integ.maxBatch = (int)std::min<double>(std::max(rate / units * seconds, 1.0), 1 << 20);
+}
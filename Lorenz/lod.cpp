@@ -0,0 +1,153 @@
+/*
+ * Coarser copies of the trail for when it is too dense to see.
+ * Level k keeps a point only once it is lodBaseError * 2^(k-1) from the
+ * last one it kept, fed from level k-1 as points arrive, so each level is
+ * built incrementally and the whole hierarchy costs O(new points) a frame.
+ * The renderer picks the coarsest level whose error is still under a pixel.
+ */
+
+#include <vector>
+#include <memory>
+
+// error of the finest decimated level, in attractor units
+const float lodBaseError = .05;
+const int lodMaxLevels = 10;
+
+struct lodLevel {
+   // points kept, with the trail history index each came from
+   pointRing ring;
+   std::unique_ptr<long[]> source;
+   trailBuffer trail;
+   float tolerance = 0;
+   lorenzPoint lastKept = {0, 0, 0, 0};
+};
+
+struct trailLod {
+   // levels[i] is level i + 1; level 0 is the full trail itself
+   std::vector<lodLevel> levels;
+   // trail history index of the next point to feed in
+   long consumed = 0;
+   // what the last draw used
+   int level = 0;
+   long submitted = 0;
+};
+
+/*
+ * Level k holds ring.capacity >> (k + 1) points, so together they take
+ * about as much memory as the ring again, but never fewer than budget,
+ * so any level cheap enough to draw also reaches back as far as the ring
+ */
+void lodInit(trailLod &lod, pointRing &ring, long budget) {
+   lod.levels.clear();
+   for (int k = 1; k <= lodMaxLevels; k++) {
+      lodLevel level;
+      long capacity = std::min(ring.capacity, std::max(ring.capacity >> (k + 1), budget));
+      ringInit(level.ring, capacity * sizeof(lorenzPoint));
+      level.source.reset(new long[capacity]);
+      level.tolerance = lodBaseError * (1 << (k - 1));
+      lod.levels.push_back(std::move(level));
+   }
+   lod.consumed = 0;
+}
+
+// Vertex buffers for each level, sharing the full trail's shader
+void lodInitBuffers(trailLod &lod, trailBuffer &base) {
+   for (auto &level : lod.levels) {
+      glGenBuffers(1, &level.trail.pointBuffer);
+      level.trail.program = base.program;
+      level.trail.velocityAttribute = base.velocityAttribute;
+   }
+}
+
+void lodClear(trailLod &lod) {
+   for (auto &level : lod.levels) {
+      ringClear(level.ring);
+      trailReset(level.trail);
+   }
+   lod.consumed = 0;
+}
+
+// Offer a point to level i, which passes on what it keeps to level i + 1
+static void lodFeed(trailLod &lod, int i, lorenzPoint &point, long source) {
+   for (; i < (int)lod.levels.size(); i++) {
+      lodLevel &level = lod.levels[i];
+      if (level.ring.total > 0) {
+         float dx = point.x - level.lastKept.x, dy = point.y - level.lastKept.y, dz = point.z - level.lastKept.z;
+         if (dx*dx + dy*dy + dz*dz < level.tolerance * level.tolerance) return;
+      }
+      level.source[level.ring.total % level.ring.capacity] = source;
+      ringPush(level.ring, point);
+      level.lastKept = point;
+   }
+}
+
+/*
+ * Feed every level the points added to ring since the last update
+ */
+void lodUpdate(trailLod &lod, pointRing &ring) {
+   // the trail was cleared underneath us
+   if (ring.total < lod.consumed) lodClear(lod);
+
+   long first = std::max(lod.consumed, ring.total - ringSize(ring));
+   for (long t = first; t < ring.total; t++) {
+      lodFeed(lod, 0, ring.slots[t % ring.capacity], t);
+   }
+   lod.consumed = ring.total;
+}
+
+// Points of level held for trail history index oldest onward
+static long lodHeldSince(lodLevel &level, long oldest) {
+   long low = 0, high = ringSize(level.ring);
+   while (low < high) {
+      long mid = (low + high) / 2;
+      if (level.source[(ringOldest(level.ring) + mid) % level.ring.capacity] < oldest) low = mid + 1;
+      else high = mid;
+   }
+   return ringSize(level.ring) - low;
+}
+
+// True if level still reaches back as far as the full trail does
+static bool lodCovers(lodLevel &level, pointRing &ring) {
+   if (level.ring.total <= level.ring.capacity) return true;
+   return level.source[ringOldest(level.ring)] <= ring.total - ringSize(ring);
+}
+
+/*
+ * Level to draw when a pixel spans pixel attractor units: the coarsest
+ * whose error stays under a pixel, or coarser still while that would
+ * submit more than budget vertices
+ */
+int lodPick(trailLod &lod, pointRing &ring, float pixel, long budget) {
+   int pick = 0;
+   long count = ringSize(ring);
+   for (int i = 0; i < (int)lod.levels.size(); i++) {
+      lodLevel &level = lod.levels[i];
+      if (!lodCovers(level, ring)) continue;
+      if (level.tolerance > pixel && count <= budget) break;
+      pick = i + 1;
+      count = lodHeldSince(level, ring.total - ringSize(ring));
+   }
+   return pick;
+}
+
+/*
+ * Draw the trail at the level lodPick chooses. full must already be
+ * synced with ring.
+ */
+void lodDraw(trailLod &lod, pointRing &ring, trailBuffer &full, float pixel, long budget, float vMin, float vMax) {
+   lod.level = lodPick(lod, ring, pixel, budget);
+   if (lod.level == 0) {
+      lod.submitted = full.count;
+      trailDraw(full, vMin, vMax);
+      return;
+   }
+
+   lodLevel &level = lod.levels[lod.level - 1];
+   trailSync(level.trail, level.ring);
+   // skip what the full trail has already forgotten
+   long held = lodHeldSince(level, ring.total - ringSize(ring));
+   level.trail.oldest = (level.trail.oldest + level.trail.count - held) % level.trail.capacity;
+   level.trail.count = held;
+   lod.submitted = held;
+   trailDraw(level.trail, vMin, vMax);
+}
@@ -24,19 +24,57 @@
 
 #include "generate.cpp"
 #include "hsv2rgb.cpp"
+#include "loadShader.cpp"
+#include "ring.cpp"
+#include "trail.cpp"
+#include "lod.cpp"
+#include "simd.cpp"
+#include "systems.cpp"
+#include "integrator.cpp"
+#include "ensemble.cpp"
+#include "pool.cpp"
+#include "sweep.cpp"
+#include "trajectoryFile.cpp"
 #include <vector>
+#include <string>
 
-std::vector<lorenzPoint> points;
+// history, oldest overwritten once memoryBudget is used up
+pointRing points;
+size_t memoryBudget = 128 << 20;
+trailBuffer trail;
+// decimated copies of the trail, and the most vertices a frame should submit
+trailLod lod;
+bool useLod = true;
+long lodBudget = 200000;
 float vMin = 500000;
 float vMax = 0;
+// half height of the view, in scene units
+const double dim = 2.5;
 const float orbitSpeed = 2.5;
-const float paramAdjustmentSensitivity = .33;
 float pitch = 0;
 float yaw = 0;
 
-float t0 = 0;
-float pointDeltaTime = 0;
+integrator integ;
+// wall clock seconds at the last idle, negative before the first and while hidden
+double lastTime = -1;
+// wall seconds of each frame the simulation may spend catching up
+const double stepBudget = .008;
 
+// a recorded trajectory played back in place of integrating
+trajectoryFile replay;
+bool replaying = false;
+uint64_t replayCursor = 0;
+
+// point cloud of many trajectories, shown instead of the trail
+ensemble cloud;
+integrator cloudInteg;
+ensembleKernel cloudKernel = ensembleBestKernel();
+bool showEnsemble = false;
+int ensembleSize = 100000;
+
+attractorKind attractor = LORENZ;
+
+// the first three parameters of the current attractor, whichever it is
 struct lorenzParams
 {
    float s;
@@ -45,43 +83,107 @@ struct lorenzParams
    float speed;
 } lorenzParams = {10.0, 2.6667, 28.0, 0.0003};
 
+// Parameters of the current attractor, the adjustable ones from lorenzParams
+void systemParams(float k[6])
+{
+   for (int i = 0; i < 6; i++) k[i] = attractors[attractor].params[i];
+   k[0] = lorenzParams.s;
+   k[1] = lorenzParams.b;
+   k[2] = lorenzParams.r;
+}
+
 void erasePoints()
 {
-   points = {{10, 12, 25, 0}};
+   ringClear(points);
+   ringPush(points, attractors[attractor].start);
+   integ.carriedAt = -1;
+   trailReset(trail);
+   lodClear(lod);
 }
 
-void addPoint()
+// Widen vMin/vMax to cover the newest added points
+void trackRange(long added)
 {
-   float dt = lorenzParams.speed * pointDeltaTime;
-   auto lastPoint = points.back();
-   auto nextPoint = marchPoint(lastPoint, dt, lorenzParams.s, lorenzParams.b, lorenzParams.r);
-   points.push_back(nextPoint);
-   
-   if (nextPoint.velocity < vMin) {
-      vMin = nextPoint.velocity;
-   }
-   
-   if (nextPoint.velocity > vMax) {
-      vMax = nextPoint.velocity;
+   long size = ringSize(points);
+   for (long i = std::max(0L, size - added); i < size; i++) {
+      float velocity = ringAt(points, i).velocity;
+      if (velocity < vMin) {
+         vMin = velocity;
+      }
+      
+      if (velocity > vMax) {
+         vMax = velocity;
+      }
    }
 }
 
-void velocityToColor(float velocity, float color[3]) {
-   float t = 0;
-   if (vMax - vMin != 0) {
-      t = (velocity - vMin) / (vMax - vMin);
+// Integrate simTime more of the simulation, returns the number of points added
+int addPoints(double simTime)
+{
+   float k[6];
+   systemParams(k);
+   int added = integratorAdvance(integ, simTime, points, attractor, k);
+   trackRange(added);
+   return added;
+}
+
+// Play simTime more of the recording at its own dt, returns the number of points added
+int replayPoints(double simTime)
+{
+   long steps = integratorTake(integ, simTime);
+   long added = std::min<uint64_t>(steps, replay.count - replayCursor);
+   for (long i = 0; i < added; i++) {
+      ringPush(points, replay.points[replayCursor++]);
    }
-   
-   float r, g, b;
-   float h = t * 360;
-   float s = 1;
-   float v = 1;
-   HSVtoRGB(r, g, b, h, s, v);
-   
-   // return
-   color[0] = r;
-   color[1] = g;
-   color[2] = b;
+   trackRange(added);
+   return added;
+}
+
+void restartReplay()
+{
+   ringClear(points);
+   trailReset(trail);
+   lodClear(lod);
+   replayCursor = 0;
+   replayPoints(integ.step);
+}
+
+// Seed the cloud in a small ball and advance it in place of the trail
+void startEnsemble()
+{
+   ensembleSeed(cloud, ensembleSize, attractors[attractor].start, .01);
+   cloudInteg.accumulator = 0;
+   // cap particle steps per frame so a big cloud degrades to slow motion, not a stall
+   cloudInteg.maxBatch = std::max(1, 20000000 / ensembleSize);
+}
+
+// Switch systems, starting over at its default parameters
+void selectAttractor(attractorKind kind)
+{
+   attractor = kind;
+   lorenzParams.s = attractors[kind].params[0];
+   lorenzParams.b = attractors[kind].params[1];
+   lorenzParams.r = attractors[kind].params[2];
+   vMin = 500000;
+   vMax = 0;
+   erasePoints();
+   if (showEnsemble) startEnsemble();
+}
+
+// Step the cloud by simTime, returns the number of steps taken
+int advanceEnsemble(double simTime)
+{
+   long steps = integratorTake(cloudInteg, simTime);
+   auto start = std::chrono::steady_clock::now();
+   float k[6];
+   systemParams(k);
+   ensembleStep(cloud, cloudKernel, attractor, steps, cloudInteg.step, k);
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   // throughput counts particle steps
+   cloudInteg.lastSteps = steps * cloud.count;
+   cloudInteg.lastSeconds = elapsed.count();
+   return steps;
 }
 
 #define LEN 8192 //  Maximum length of text string
@@ -114,25 +216,29 @@ void draw()
 
    {
       glPushMatrix();
-      const float scale = .03;
+      const float scale = attractors[attractor].scale;
       glScalef(scale, scale, scale);
 
-      glBegin(GL_LINES);
       glLineWidth(1.0f);
 
-      for (int i = 0; i < points.size() - 1; i++)
-      {
-         auto pointA = points[i];
-         auto pointB = points[i + 1];
-
-         float color[3];
-         velocityToColor(pointB.velocity, color);
-         glColor3f(color[0], color[1], color[2]);
-         glVertex3f(pointA.x, pointA.y, pointA.z);
-         glVertex3f(pointB.x, pointB.y, pointB.z);
+      if (showEnsemble) {
+         ensembleDraw(cloud);
+      } else {
+         // upload what is new since last frame, then draw the whole strip,
+         // decimated to what the viewport can actually show
+         trailSync(trail, points);
+         lodUpdate(lod, points);
+         int viewport[4];
+         glGetIntegerv(GL_VIEWPORT, viewport);
+         float pixel = 2 * dim / std::max(viewport[3], 1) / scale;
+         if (useLod) {
+            lodDraw(lod, points, trail, pixel, lodBudget, vMin, vMax);
+         } else {
+            lod.level = 0;
+            lod.submitted = trail.count;
+            trailDraw(trail, vMin, vMax);
+         }
       }
-
-      glEnd();
       glPopMatrix();
    }
 
@@ -161,7 +267,25 @@ void draw()
    {
       //-------------------- Specs
       glWindowPos2i(5, 5);
-      Print("S %.2f, B %.2f, R %.2f", lorenzParams.s, lorenzParams.b, lorenzParams.r);
+      const attractorInfo &info = attractors[attractor];
+      float shown[3] = {lorenzParams.s, lorenzParams.b, lorenzParams.r};
+      Print("%s", info.name);
+      for (int i = 0; i < 3 && info.paramNames[i]; i++)
+         Print(", %s %.3g", info.paramNames[i], shown[i]);
+      glWindowPos2i(5, 25);
+      if (replaying)
+         Print("Replaying %llu of %llu points", (unsigned long long)replayCursor, (unsigned long long)replay.count);
+      else if (showEnsemble)
+         Print("%d particles, %s, %.1fM particle steps/s", cloud.count, ensembleKernelNames[cloudKernel],
+               integratorThroughput(cloudInteg) / 1e6);
+      else
+         Print("%s in %s, %.0f steps/s simulated, %.1fM steps/s capacity", integratorNames[integ.method],
+               precisionNames[integ.precision], lorenzParams.speed * 1000 / integ.step, integratorThroughput(integ) / 1e6);
+      if (!showEnsemble) {
+         glWindowPos2i(5, 45);
+         Print("%ld of %ld points drawn (detail level %d%s)", lod.submitted, ringSize(points), lod.level,
+               useLod ? "" : ", off");
+      }
    }
 
    glutSwapBuffers();
@@ -171,18 +295,23 @@ void draw()
 // -------- Idle Hook -------- //
 void idle()
 {
-   const float newPointThreshold = .003;
-   float dt = lorenzParams.speed * pointDeltaTime;
+   double now = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
+   if (lastTime < 0) lastTime = now;
    
-   if (dt > newPointThreshold) {
-      addPoint();
+   // speed is simulation time per millisecond of wall time
+   double simTime = (now - lastTime) * 1000 * lorenzParams.speed * attractors[attractor].pace;
+   lastTime = now;
+
+   // a slow frame or a long pause drops the backlog past one frame's work
+   if (showEnsemble)
+      integratorBudget(cloudInteg, stepBudget, cloud.count);
+   else
+      integratorBudget(integ, stepBudget);
+   
+   int added = showEnsemble ? advanceEnsemble(simTime) : replaying ? replayPoints(simTime) : addPoints(simTime);
+   if (added > 0) {
       glutPostRedisplay();
-      pointDeltaTime = 0;
-      t0 = glutGet(GLUT_ELAPSED_TIME);
    }
-   
-   if (t0 == 0) t0 = glutGet(GLUT_ELAPSED_TIME);
-   pointDeltaTime = glutGet(GLUT_ELAPSED_TIME) - t0;
 }
 
 // -------- Window Reshape -------- //
@@ -195,7 +324,6 @@ void reshape(int width, int height)
    //  Undo previous transformations
    glLoadIdentity();
    //  Orthogonal projection
-   const double dim = 2.5;
    double asp = (height > 0) ? (double)width / height : 1;
    glOrtho(-asp * dim, +asp * dim, -dim, +dim, -dim, +dim);
    //  Switch to manipulating the model matrix
@@ -207,27 +335,56 @@ void reshape(int width, int height)
 void key(unsigned char ch, int x, int y) {
    switch (ch) {
       case 's':
-         lorenzParams.s += paramAdjustmentSensitivity;
+         lorenzParams.s += attractors[attractor].sensitivity;
          break;
       case 'S':
-         lorenzParams.s -= paramAdjustmentSensitivity;
+         lorenzParams.s -= attractors[attractor].sensitivity;
          break;
       case 'b':
-         lorenzParams.b += paramAdjustmentSensitivity;
+         lorenzParams.b += attractors[attractor].sensitivity;
          break;
       case 'B':
-         lorenzParams.b -= paramAdjustmentSensitivity;
+         lorenzParams.b -= attractors[attractor].sensitivity;
          break;
       case 'r':
-         lorenzParams.r += paramAdjustmentSensitivity;
+         lorenzParams.r += attractors[attractor].sensitivity;
          break;
       case 'R':
-         lorenzParams.r -= paramAdjustmentSensitivity;
+         lorenzParams.r -= attractors[attractor].sensitivity;
          break;
       case ' ':
-         erasePoints();
+         if (replaying) restartReplay();
+         else erasePoints();
          glutPostRedisplay();
          break;
+      case 'e':
+         showEnsemble = !showEnsemble;
+         if (showEnsemble) startEnsemble();
+         glutPostRedisplay();
+         break;
+      case 'a':
+         if (replaying) break;
+         selectAttractor((attractorKind)((attractor + 1) % attractorCount));
+         glutPostRedisplay();
+         break;
+      case 'l':
+         useLod = !useLod;
+         glutPostRedisplay();
+         break;
+      case 'i':
+         integ.method = (integratorMethod)((integ.method + 1) % 3);
+         glutPostRedisplay();
+         break;
+      case 'p':
+         integ.precision = (precisionMode)((integ.precision + 1) % 3);
+         glutPostRedisplay();
+         break;
+      case '+':
+         lorenzParams.speed *= 2;
+         break;
+      case '-':
+         lorenzParams.speed /= 2;
+         break;
       default:
          return;
    }
@@ -271,10 +428,436 @@ void visible(int vis)
       glutIdleFunc(idle);
    else
       glutIdleFunc(NULL);
+   // time spent hidden is not owed to the simulation
+   lastTime = -1;
+}
+
+/*
+ * Worst error of one derivative in float and in double at every 1000th
+ * point of ring, against the same derivative in long double
+ */
+template <class System>
+static void derivativeErrors(pointRing &ring, const float k[], double worst[2])
+{
+   worst[0] = worst[1] = 0;
+   for (long i = 0; i < ringSize(ring); i += 1000) {
+      lorenzPoint q = ringAt(ring, i);
+      float pf[3] = {q.x, q.y, q.z}, df[3];
+      double pd[3] = {q.x, q.y, q.z}, dd[3];
+      long double pl[3] = {q.x, q.y, q.z}, dl[3];
+      System::derivative(pf, k, df);
+      System::derivative(pd, k, dd);
+      System::derivative(pl, k, dl);
+      for (int j = 0; j < 3; j++) {
+         worst[0] = std::max(worst[0], (double)fabsl(df[j] - dl[j]));
+         worst[1] = std::max(worst[1], (double)fabsl(dd[j] - dl[j]));
+      }
+   }
+}
+
+/*
+ * Headless: time each integrator, then check that slicing the same
+ * simulation time into different frame rates gives the same points
+ */
+int benchmark()
+{
+   const int steps = 1000000;
+   for (int method = 0; method < 3; method++) {
+      integ.method = (integratorMethod)method;
+      erasePoints();
+      addPoints(steps * integ.step);
+      auto last = ringBack(points);
+      printf("%-6s %8.2fM steps/s, ends at (%.3f, %.3f, %.3f)\n", integratorNames[method],
+             integratorThroughput(integ) / 1e6, last.x, last.y, last.z);
+   }
+
+   bool same = true;
+   for (int method = 0; method < 3; method++) {
+      integ.method = (integratorMethod)method;
+      std::vector<lorenzPoint> runs[2];
+      const double frameRates[] = {30, 144};
+      for (int run = 0; run < 2; run++) {
+         erasePoints();
+         integ.accumulator = 0;
+         for (int frame = 0; frame < 10 * frameRates[run]; frame++)
+            addPoints(1000 * lorenzParams.speed / frameRates[run]);
+         runs[run] = ringSnapshot(points);
+      }
+
+      int shared = std::min(runs[0].size(), runs[1].size());
+      bool match = memcmp(runs[0].data(), runs[1].data(), shared * sizeof(lorenzPoint)) == 0;
+      printf("%-6s %d points at 30 fps, %d at 144 fps: %s\n", integratorNames[method],
+             (int)runs[0].size(), (int)runs[1].size(), match ? "identical" : "DIFFERENT");
+      same = same && match;
+   }
+
+   // once fitted to a frame, a backlog of ten frames' work costs about one
+   {
+      integratorMethod method = integ.method;
+      integ.method = RK4;
+      erasePoints();
+      addPoints(100000 * integ.step);
+      integratorBudget(integ, stepBudget);
+      auto start = std::chrono::steady_clock::now();
+      int added = addPoints(10.0 * integ.maxBatch * integ.step);
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      printf("RK4 backlog of %d steps at a %.0f ms budget: took %d in %.2f ms\n", 10 * integ.maxBatch,
+             stepBudget * 1000, added, elapsed.count());
+      same = same && added == integ.maxBatch;
+      integ.maxBatch = 1 << 20;
+      integ.method = method;
+   }
+
+   // a streamed file maps back to exactly what generate() returns
+   {
+      const long amount = 1000000;
+      const char *path = "lorenz-bench.lrzt";
+      auto start = std::chrono::steady_clock::now();
+      bool match = generateToFile(path, amount, 10.0, 2.6666, 28.0, .001);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      trajectoryFile file;
+      lorenzPoint *expected = generate(amount);
+      match = match && trajectoryMap(file, path) && file.count == (uint64_t)amount;
+      match = match && memcmp(file.points, expected, amount * sizeof(lorenzPoint)) == 0;
+      printf("Streamed %ld points to disk at %.0f MB/s, mapped back %s\n", amount,
+             amount * sizeof(lorenzPoint) / elapsed.count() / (1 << 20), match ? "identical to generate()" : "DIFFERENT");
+      delete[] expected;
+      trajectoryUnmap(file);
+      remove(path);
+      same = same && match;
+   }
+
+   // pushes cost the same empty or full, and a full ring keeps the newest points in order
+   {
+      pointRing ring;
+      ringInit(ring, 1000 * sizeof(lorenzPoint));
+      const long pushes = 10000000;
+      auto start = std::chrono::steady_clock::now();
+      for (long i = 0; i < pushes; i++)
+         ringPush(ring, {(float)i, 0, 0, 0});
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+      bool ordered = ringSize(ring) == ring.capacity;
+      for (long i = 0; i < ringSize(ring); i++)
+         ordered = ordered && ringAt(ring, i).x == (float)(pushes - ring.capacity + i);
+      printf("Ring of %ld: %.2f ns per push, %s\n", ring.capacity, elapsed.count() / pushes,
+             ordered ? "keeps the newest in order" : "OUT OF ORDER");
+      same = same && ordered;
+   }
+
+   // precision: throughput against how soon rounding takes the trajectory
+   // somewhere else than the double run of the same method, for Lorenz and
+   // for Thomas, whose sines must not drop to float in the double modes
+   for (attractorKind system : {LORENZ, THOMAS}) {
+      const long steps = 1000000;
+      const float *k = attractors[system].params;
+      printf("%s:\n", attractors[system].name);
+      for (int method = 0; method < 3; method++) {
+         pointRing runs[3];
+         double rates[3];
+         for (int mode = 0; mode < 3; mode++) {
+            integrator run;
+            run.method = (integratorMethod)method;
+            run.precision = (precisionMode)mode;
+            run.maxBatch = steps;
+            ringInit(runs[mode], (steps + 1) * sizeof(lorenzPoint));
+            ringPush(runs[mode], attractors[system].start);
+            integratorAdvance(run, (steps + .5) * run.step, runs[mode], system, k);
+            rates[mode] = integratorThroughput(run);
+         }
+
+         pointRing &reference = runs[DOUBLE_PRECISION];
+         for (int mode = 0; mode < 3; mode++) {
+            double off[3] = {0, 0, 0};
+            long checkpoints[3] = {1000, 10000, 100000}, separated = -1;
+            for (long i = 0; i < ringSize(reference); i++) {
+               lorenzPoint a = ringAt(runs[mode], i), b = ringAt(reference, i);
+               double distance = sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) + (a.z-b.z)*(a.z-b.z));
+               for (int c = 0; c < 3; c++)
+                  if (i == checkpoints[c]) off[c] = distance;
+               if (distance > 1 && separated < 0) separated = i;
+            }
+            printf("%-5s %-12s %6.2fM steps/s, off by %.1e / %.1e / %.1e after 1k / 10k / 100k steps, ",
+                   integratorNames[method], precisionNames[mode], rates[mode] / 1e6, off[0], off[1], off[2]);
+            if (mode == DOUBLE_PRECISION) printf("the reference\n");
+            else printf("more than 1 apart from step %ld\n", separated);
+         }
+
+         if (method == EULER) {
+            double worst[2];
+            if (system == THOMAS) derivativeErrors<thomasSystem>(reference, k, worst);
+            else derivativeErrors<lorenzSystem>(reference, k, worst);
+            bool drops = worst[1] < worst[0] * 1e-4;
+            printf("      derivative off by %.1e in float, %.1e in double: %s\n", worst[0], worst[1],
+                   drops ? "double is exact to its own precision" : "DOUBLE NO BETTER THAN FLOAT");
+            same = same && drops;
+         }
+      }
+   }
+
+   // colors per second one at a time against the batch kernels, which
+   // must stay within rounding of the scalar functions (the table within a bin)
+   {
+      const int colors = 1 << 20;
+      std::vector<float> h(colors), sat(colors), val(colors), r(colors), g(colors), b(colors);
+      std::vector<float> br(colors), bg(colors), bb(colors);
+      srand(2);
+      for (int i = 0; i < colors; i++) {
+         h[i] = 360.0f * rand() / RAND_MAX;
+         sat[i] = rand() / (float)RAND_MAX;
+         val[i] = rand() / (float)RAND_MAX;
+      }
+
+      auto rate = [&](std::function<void()> run) {
+         auto start = std::chrono::steady_clock::now();
+         run();
+         std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+         return colors / elapsed.count() / 1e6;
+      };
+      auto worst = [&](std::vector<float> *a, std::vector<float> *b) {
+         float error = 0;
+         for (int c = 0; c < 3; c++)
+            for (int i = 0; i < colors; i++)
+               error = std::max(error, std::fabs(a[c][i] - b[c][i]));
+         return error;
+      };
+
+      double scalar = rate([&] {
+         for (int i = 0; i < colors; i++) HSVtoRGB(r[i], g[i], b[i], h[i], sat[i], val[i]);
+      });
+      double batch = rate([&] { HSVtoRGBBatch(br.data(), bg.data(), bb.data(), h.data(), sat.data(), val.data(), colors); });
+      std::vector<float> scalarRGB[] = {r, g, b}, batchRGB[] = {br, bg, bb};
+      float batchError = worst(scalarRGB, batchRGB);
+      double lookup = rate([&] { HSVtoRGBLookup(br.data(), bg.data(), bb.data(), h.data(), sat.data(), val.data(), colors); });
+      std::vector<float> lookupRGB[] = {br, bg, bb};
+      float lookupError = worst(scalarRGB, lookupRGB);
+      printf("HSVtoRGB %7.1fM colors/s, batch %7.1fM off by %.1e, table %7.1fM off by %.1e\n",
+             scalar, batch, batchError, lookup, lookupError);
+
+      std::vector<float> sh(colors), ss(colors), sv(colors);
+      scalar = rate([&] {
+         for (int i = 0; i < colors; i++) RGBtoHSV(r[i], g[i], b[i], sh[i], ss[i], sv[i]);
+      });
+      batch = rate([&] { RGBtoHSVBatch(r.data(), g.data(), b.data(), h.data(), sat.data(), val.data(), colors); });
+      std::vector<float> scalarHSV[] = {sh, ss, sv}, batchHSV[] = {h, sat, val};
+      // hue is in degrees, so compare it in turns like the others
+      for (int i = 0; i < colors; i++) {
+         scalarHSV[0][i] /= 360;
+         batchHSV[0][i] /= 360;
+      }
+      float hsvError = worst(scalarHSV, batchHSV);
+      printf("RGBtoHSV %7.1fM colors/s, batch %7.1fM off by %.1e\n", scalar, batch, hsvError);
+
+      bool close = batchError < 1e-5 && hsvError < 1e-5 && lookupError <= 1 / 512.0f + 1e-5;
+      if (!close) printf("Batch colors are OUT OF TOLERANCE\n");
+      same = same && close;
+   }
+
+   // submitted vertices level off as history grows, at a fraction of a point per point
+   {
+      pointRing ring;
+      ringInit(ring, memoryBudget);
+      trailLod levels;
+      lodInit(levels, ring, lodBudget);
+      float pixel = 2 * dim / 800 / .03;
+      lorenzPoint point = {10, 12, 25, 0};
+      std::chrono::duration<double, std::nano> elapsed(0);
+      for (long checkpoint = 1 << 17; checkpoint <= 2 * ring.capacity; checkpoint *= 4) {
+         while (ring.total < checkpoint) {
+            point = marchPoint(point, .003, lorenzParams.s, lorenzParams.b, lorenzParams.r);
+            ringPush(ring, point);
+         }
+         auto start = std::chrono::steady_clock::now();
+         lodUpdate(levels, ring);
+         elapsed += std::chrono::steady_clock::now() - start;
+         int level = lodPick(levels, ring, pixel, lodBudget);
+         long drawn = level ? lodHeldSince(levels.levels[level - 1], ring.total - ringSize(ring)) : ringSize(ring);
+         printf("Trail of %8ld points at 800 px: level %d, %ld vertices\n", ringSize(ring), level, drawn);
+         same = same && drawn <= lodBudget;
+      }
+      printf("Detail levels cost %.2f ns per point\n", elapsed.count() / ring.total);
+   }
+
+   // particles x steps per second, one trajectory at a time and then as an ensemble
+   const int particles = 100000;
+   const long ensembleSteps = 100;
+   ensemble reference;
+   ensembleSeed(reference, particles, {10, 12, 25, 0}, .01);
+   {
+      std::vector<lorenzPoint> seeds(particles);
+      for (int i = 0; i < particles; i++)
+         seeds[i] = {reference.x[i], reference.y[i], reference.z[i], 0};
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < particles; i++)
+         for (long step = 0; step < ensembleSteps; step++)
+            seeds[i] = marchPoint(seeds[i], integ.step, lorenzParams.s, lorenzParams.b, lorenzParams.r);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      printf("%-10s %8.1fM particle steps/s\n", "marchPoint", particles * ensembleSteps / elapsed.count() / 1e6);
+   }
+
+   float k[6];
+   systemParams(k);
+   ensemble scalar = reference;
+   ensembleStep(scalar, ENSEMBLE_SCALAR, LORENZ, ensembleSteps, integ.step, k);
+   for (int kernel = 0; kernel <= ensembleBestKernel(); kernel++) {
+      ensemble run = reference;
+      auto start = std::chrono::steady_clock::now();
+      ensembleStep(run, (ensembleKernel)kernel, LORENZ, ensembleSteps, integ.step, k);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      bool match = run.x == scalar.x && run.y == scalar.y && run.z == scalar.z;
+      printf("%-10s %8.1fM particle steps/s, %s scalar\n", ensembleKernelNames[kernel],
+             particles * ensembleSteps / elapsed.count() / 1e6, match ? "matches" : "DIFFERS FROM");
+      same = same && match;
+   }
+
+   // the templated Euler step is marchPoint exactly
+   {
+      lorenzPoint marched = {10, 12, 25, 0}, templated = marched;
+      for (int i = 0; i < 100000; i++) {
+         marched = marchPoint(marched, integ.step, k[0], k[1], k[2]);
+         templated = eulerPoint<lorenzSystem>(templated, integ.step, k);
+      }
+      bool match = memcmp(&marched, &templated, sizeof(lorenzPoint)) == 0;
+      printf("eulerPoint<lorenzSystem> %s marchPoint\n", match ? "matches" : "DIFFERS FROM");
+      same = same && match;
+   }
+
+   // every other system through the best kernel, against its own scalar run
+   for (int kind = ROSSLER; kind < attractorCount; kind++) {
+      const attractorInfo &info = attractors[kind];
+      ensemble seeded;
+      ensembleSeed(seeded, particles, info.start, .01);
+      ensemble scalar = seeded, best = seeded;
+      ensembleStep(scalar, ENSEMBLE_SCALAR, (attractorKind)kind, ensembleSteps, integ.step, info.params);
+      auto start = std::chrono::steady_clock::now();
+      ensembleStep(best, cloudKernel, (attractorKind)kind, ensembleSteps, integ.step, info.params);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      bool match = best.x == scalar.x && best.y == scalar.y && best.z == scalar.z;
+      printf("%-10s %8.1fM particle steps/s with %s, %s scalar\n", info.name,
+             particles * ensembleSteps / elapsed.count() / 1e6, ensembleKernelNames[cloudKernel],
+             match ? "matches" : "DIFFERS FROM");
+      same = same && match;
+   }
+
+   // the sweep's exponent for the classic parameters against the published one
+   {
+      lyapunovSettings run = lyapunovFor(integ.step);
+      double lyapunov = lyapunovExponent(10, 8.0 / 3, 28, run.dt, run.transient, run.steps);
+      bool close = fabs(lyapunov / classicLyapunov - 1) < .03;
+      printf("Sweep Lyapunov exponent %.4f for the classic parameters, %s %.4f\n",
+             lyapunov, close ? "within 3% of" : "MORE THAN 3% FROM", classicLyapunov);
+      same = same && close;
+   }
+   return same ? 0 : 1;
+}
+
+/*
+ * Headless chaos map over (s, b, r). An axis with one sample holds the
+ * current parameter instead of spanning its range.
+ */
+int sweep(int counts[3], int threads, const char *prefix)
+{
+   sweepGrid grid;
+   grid.s = {1, 30, counts[0]};
+   grid.b = {.5, 5, counts[1]};
+   grid.r = {1, 100, counts[2]};
+   if (grid.s.count == 1) grid.s.min = lorenzParams.s;
+   if (grid.b.count == 1) grid.b.min = lorenzParams.b;
+   if (grid.r.count == 1) grid.r.min = lorenzParams.r;
+
+   lyapunovSettings run = lyapunovFor(integ.step);
+   printf("Classic parameters: largest Lyapunov exponent %.3f (published %.3f), %d steps of %g per cell\n",
+          lyapunovExponent(10, 8.0 / 3, 28, run.dt, run.transient, run.steps), classicLyapunov,
+          run.transient + run.steps, run.dt);
+
+   auto start = std::chrono::steady_clock::now();
+   sweepRun(grid, threads, run.dt, run.transient, run.steps);
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   int cells = grid.lyapunov.size();
+   printf("Swept %d x %d x %d cells on %d threads in %.2f s (%.0f cells/s, %.1fM steps/s)\n",
+          grid.s.count, grid.b.count, grid.r.count, threads, elapsed.count(), cells / elapsed.count(),
+          (double)cells * (run.transient + run.steps) / elapsed.count() / 1e6);
+
+   std::string binary = std::string(prefix) + ".bin", image = std::string(prefix) + ".pgm";
+   if (!sweepWriteBinary(grid, binary.c_str()) || !sweepWritePGM(grid, image.c_str())) {
+      fprintf(stderr, "Could not write %s\n", prefix);
+      return 1;
+   }
+   printf("Wrote %s and %s\n", binary.c_str(), image.c_str());
+   return 0;
 }
 
 int main(int argc, char *argv[])
 {
+   bool bench = false;
+   int sweepCounts[3] = {0, 0, 0};
+   int threads = poolDefaultThreads();
+   const char *sweepPrefix = "sweep";
+   long exportAmount = 0;
+   const char *exportPath = NULL;
+   const char *replayPath = NULL;
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-bench") == 0)
+         bench = true;
+      // -ensemble N starts with a cloud of N particles
+      else if (strcmp(argv[i], "-ensemble") == 0 && i + 1 < argc) {
+         ensembleSize = std::max(1, atoi(argv[i + 1]));
+         showEnsemble = true;
+      }
+      // -sweep NS NB NR maps chaos over a grid of parameters
+      else if (strcmp(argv[i], "-sweep") == 0 && i + 3 < argc) {
+         for (int axis = 0; axis < 3; axis++)
+            sweepCounts[axis] = std::max(1, atoi(argv[i + 1 + axis]));
+      }
+      else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+         threads = std::max(1, atoi(argv[i + 1]));
+      else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+         sweepPrefix = argv[i + 1];
+      // -export N file streams N generate() steps to file and exits
+      else if (strcmp(argv[i], "-export") == 0 && i + 2 < argc) {
+         exportAmount = atol(argv[i + 1]);
+         exportPath = argv[i + 2];
+      }
+      // -replay file plays a recording instead of integrating
+      else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+         replayPath = argv[i + 1];
+      // -memory MB bounds the trail history
+      else if (strcmp(argv[i], "-memory") == 0 && i + 1 < argc)
+         memoryBudget = (size_t)std::max(1, atoi(argv[i + 1])) << 20;
+   }
+   ringInit(points, memoryBudget);
+
+   if (bench) {
+      return benchmark();
+   }
+   if (sweepCounts[0]) {
+      return sweep(sweepCounts, threads, sweepPrefix);
+   }
+   if (exportPath) {
+      auto start = std::chrono::steady_clock::now();
+      if (!generateToFile(exportPath, exportAmount, lorenzParams.s, lorenzParams.b, lorenzParams.r, .001)) {
+         fprintf(stderr, "Could not write %s\n", exportPath);
+         return 1;
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      printf("Wrote %ld points to %s in %.2f s\n", exportAmount, exportPath, elapsed.count());
+      return 0;
+   }
+   if (replayPath) {
+      if (!trajectoryMap(replay, replayPath)) {
+         fprintf(stderr, "Could not read %s\n", replayPath);
+         return 1;
+      }
+      lorenzParams.s = replay.header.s;
+      lorenzParams.b = replay.header.b;
+      lorenzParams.r = replay.header.r;
+      integ.step = replay.header.dt;
+      replaying = true;
+   }
+
    //  Initialize GLUT and process user parameters
    glutInit(&argc, argv);
    //  Request double buffered, true color window with Z buffering at 600x600
@@ -291,7 +874,13 @@ int main(int argc, char *argv[])
    }
 #endif
 
+   trailInit(trail);
+   lodInit(lod, points, lodBudget);
+   lodInitBuffers(lod, trail);
+   ensembleInit(cloud);
    erasePoints();
+   if (replaying) restartReplay();
+   if (showEnsemble) startEnsemble();
 
    glutDisplayFunc(draw);
    glutReshapeFunc(reshape);
@@ -0,0 +1,80 @@
+/*
+ * Work-stealing thread pool for batches of independent jobs.
+ * Each worker owns a deque of job indices and works from its back; when
+ * it runs dry it steals from the front of another worker's deque, so
+ * uneven jobs still keep every core busy until the batch is done.
+ */
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+struct workQueue {
+   std::mutex lock;
+   std::deque<int> jobs;
+};
+
+// Worker count to use when none is asked for
+int poolDefaultThreads() {
+   int threads = std::thread::hardware_concurrency();
+   return threads > 0 ? threads : 1;
+}
+
+static bool poolPop(workQueue &queue, int &job) {
+   std::lock_guard<std::mutex> guard(queue.lock);
+   if (queue.jobs.empty()) return false;
+   job = queue.jobs.back();
+   queue.jobs.pop_back();
+   return true;
+}
+
+static bool poolSteal(workQueue &queue, int &job) {
+   std::lock_guard<std::mutex> guard(queue.lock);
+   if (queue.jobs.empty()) return false;
+   job = queue.jobs.front();
+   queue.jobs.pop_front();
+   return true;
+}
+
+/*
+ * Run work(job) for every job in [0, jobs) on threads workers and wait.
+ * Jobs are dealt out in contiguous blocks, then rebalanced by stealing.
+ */
+void poolRun(int jobs, int threads, std::function<void(int)> work) {
+   if (threads < 1) threads = 1;
+   std::vector<workQueue> queues(threads);
+   for (int t = 0; t < threads; t++) {
+      int first = (long)jobs * t / threads, last = (long)jobs * (t + 1) / threads;
+      for (int job = first; job < last; job++) queues[t].jobs.push_back(job);
+   }
+
+   auto worker = [&](int self) {
+      int job;
+      while (true) {
+         if (poolPop(queues[self], job)) {
+            work(job);
+            continue;
+         }
+
+         // nothing left at home, try everyone else once around
+         bool stole = false;
+         for (int i = 1; i < threads && !stole; i++) {
+            stole = poolSteal(queues[(self + i) % threads], job);
+         }
+         // jobs never spawn jobs, so empty everywhere means done
+         if (!stole) return;
+         work(job);
+      }
+   };
+
+   std::vector<std::thread> workers;
+   for (int t = 1; t < threads; t++) {
+      workers.push_back(std::thread(worker, t));
+   }
+   worker(0);
+   for (auto &thread : workers) {
+      thread.join();
+   }
+}
@@ -0,0 +1,58 @@
+/*
+ * Fixed capacity history of points that overwrites the oldest once full.
+ * Storage is allocated once from a memory budget, so pushes never copy
+ * and memory stays flat however long the simulation runs.
+ */
+
+#include <vector>
+#include <memory>
+
+struct pointRing {
+   // left uninitialized, so untouched slots cost no physical memory
+   std::unique_ptr<lorenzPoint[]> slots;
+   long capacity = 0;
+   // points pushed since the last clear, including overwritten ones
+   long total = 0;
+};
+
+void ringInit(pointRing &ring, size_t budgetBytes) {
+   ring.capacity = std::max<long>(2, budgetBytes / sizeof(lorenzPoint));
+   ring.slots.reset(new lorenzPoint[ring.capacity]);
+   ring.total = 0;
+}
+
+void ringClear(pointRing &ring) {
+   ring.total = 0;
+}
+
+long ringSize(pointRing &ring) {
+   return std::min(ring.total, ring.capacity);
+}
+
+void ringPush(pointRing &ring, lorenzPoint point) {
+   ring.slots[ring.total % ring.capacity] = point;
+   ring.total++;
+}
+
+// Slot of the oldest point still held
+long ringOldest(pointRing &ring) {
+   return ring.total > ring.capacity ? ring.total % ring.capacity : 0;
+}
+
+// i-th oldest point still held
+lorenzPoint &ringAt(pointRing &ring, long i) {
+   return ring.slots[(ringOldest(ring) + i) % ring.capacity];
+}
+
+lorenzPoint &ringBack(pointRing &ring) {
+   return ring.slots[(ring.total - 1) % ring.capacity];
+}
+
+// Copy of the held points, oldest first
+std::vector<lorenzPoint> ringSnapshot(pointRing &ring) {
+   std::vector<lorenzPoint> copy(ringSize(ring));
+   for (long i = 0; i < (long)copy.size(); i++) {
+      copy[i] = ringAt(ring, i);
+   }
+   return copy;
+}
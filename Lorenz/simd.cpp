@@ -0,0 +1,72 @@
+/*
+ * SSE and AVX registers wrapped with ordinary arithmetic operators, so
+ * the same templated equations can run on 1, 4 or 8 lanes at a time.
+ * Every operator is the single matching instruction, so the lanes agree
+ * with plain float math bit for bit.
+ */
+
+#include <math.h>
+
+inline float sinOf(float a) {
+   return sinf(a);
+}
+
+// without these a double or long double system would narrow to sinf
+inline double sinOf(double a) {
+   return sin(a);
+}
+
+inline long double sinOf(long double a) {
+   return sinl(a);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+
+// for functions that may only run once __builtin_cpu_supports("avx") says so
+#define SIMD_AVX __attribute__((target("avx")))
+
+struct float4 {
+   __m128 v;
+   float4() {}
+   float4(__m128 v) : v(v) {}
+   float4(float f) : v(_mm_set1_ps(f)) {}
+};
+
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline void store4(float *p, float4 a) { _mm_storeu_ps(p, a.v); }
+inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator-(float4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.f)); }
+
+// no vector sine, so one lane at a time through the same sinf as scalar code
+inline float4 sinOf(float4 a) {
+   alignas(16) float lanes[4];
+   _mm_store_ps(lanes, a.v);
+   for (int i = 0; i < 4; i++) lanes[i] = sinf(lanes[i]);
+   return _mm_load_ps(lanes);
+}
+
+struct float8 {
+   __m256 v;
+   SIMD_AVX float8() {}
+   SIMD_AVX float8(__m256 v) : v(v) {}
+   SIMD_AVX float8(float f) : v(_mm256_set1_ps(f)) {}
+};
+
+SIMD_AVX inline float8 load8(const float *p) { return _mm256_loadu_ps(p); }
+SIMD_AVX inline void store8(float *p, float8 a) { _mm256_storeu_ps(p, a.v); }
+SIMD_AVX inline float8 operator+(float8 a, float8 b) { return _mm256_add_ps(a.v, b.v); }
+SIMD_AVX inline float8 operator-(float8 a, float8 b) { return _mm256_sub_ps(a.v, b.v); }
+SIMD_AVX inline float8 operator*(float8 a, float8 b) { return _mm256_mul_ps(a.v, b.v); }
+SIMD_AVX inline float8 operator-(float8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+
+SIMD_AVX inline float8 sinOf(float8 a) {
+   alignas(32) float lanes[8];
+   _mm256_store_ps(lanes, a.v);
+   for (int i = 0; i < 8; i++) lanes[i] = sinf(lanes[i]);
+   return _mm256_load_ps(lanes);
+}
+#endif
@@ -0,0 +1,155 @@
+/*
+ * Headless chaos map: the largest Lyapunov exponent over a grid of
+ * (s, b, r), computed on every core and saved as an image and raw floats.
+ */
+
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+
+struct sweepRange {
+   float min;
+   float max;
+   int count;
+};
+
+struct sweepGrid {
+   sweepRange s, b, r;
+   // indexed [r][b][s]
+   std::vector<float> lyapunov;
+};
+
+// Grid value i of range; a single sample sits at min
+float sweepValue(sweepRange &range, int i) {
+   if (range.count < 2) return range.min;
+   return range.min + (range.max - range.min) * i / (range.count - 1);
+}
+
+/*
+ * Largest Lyapunov exponent by Benettin's method. A tangent vector rides
+ * along with the trajectory through the Jacobian of the same Euler map
+ * marchPoint applies, and its log growth is summed at each renormalization.
+ * Doubles, since the tangent shrinks and grows by many orders of magnitude.
+ * Returns NAN if the trajectory blows up.
+ */
+double lyapunovExponent(double s, double b, double r, double dt, int transient, int steps) {
+   double x = 10, y = 12, z = 25;
+   for (int i = 0; i < transient; i++) {
+      double dx = s*(y-x), dy = x*(r-z)-y, dz = x*y - b*z;
+      x += dt*dx;
+      y += dt*dy;
+      z += dt*dz;
+   }
+
+   const int renormalize = 10;
+   double tx = 1, ty = 0, tz = 0;
+   double sum = 0;
+   for (int i = 1; i <= steps; i++) {
+      // tangent through I + dt*J, with J the Lorenz Jacobian at the current point
+      double ntx = tx + dt*(s*(ty-tx));
+      double nty = ty + dt*((r-z)*tx - ty - x*tz);
+      double ntz = tz + dt*(y*tx + x*ty - b*tz);
+      tx = ntx;
+      ty = nty;
+      tz = ntz;
+
+      double dx = s*(y-x), dy = x*(r-z)-y, dz = x*y - b*z;
+      x += dt*dx;
+      y += dt*dy;
+      z += dt*dz;
+
+      if (i % renormalize == 0) {
+         double length = sqrt(tx*tx + ty*ty + tz*tz);
+         if (!std::isfinite(length) || !std::isfinite(x) || length == 0) return NAN;
+         sum += log(length);
+         tx /= length;
+         ty /= length;
+         tz /= length;
+      }
+   }
+   return sum / (steps * dt);
+}
+
+/*
+ * Step and lengths for an estimate good to a few percent. At the trail's
+ * .003 step the Euler map's own exponent is about 4% above the flow's
+ * (0.941 for the classic parameters against 0.906), so the sweep takes
+ * thirds of it; and a finite run wanders by a few percent either way, so
+ * it averages over 200 time units after discarding 20.
+ */
+struct lyapunovSettings {
+   double dt;
+   int transient;
+   int steps;
+};
+
+lyapunovSettings lyapunovFor(double step) {
+   double dt = step / 3;
+   return {dt, (int)(20 / dt), (int)(200 / dt)};
+}
+
+// the published largest exponent for s = 10, b = 8/3, r = 28
+const double classicLyapunov = 0.9056;
+
+/*
+ * Fill grid.lyapunov on threads workers, one job per row of s values
+ */
+void sweepRun(sweepGrid &grid, int threads, double dt, int transient, int steps) {
+   int rows = grid.r.count * grid.b.count;
+   grid.lyapunov.assign(rows * grid.s.count, 0);
+
+   poolRun(rows, threads, [&](int row) {
+      float r = sweepValue(grid.r, row / grid.b.count);
+      float b = sweepValue(grid.b, row % grid.b.count);
+      for (int i = 0; i < grid.s.count; i++) {
+         float s = sweepValue(grid.s, i);
+         grid.lyapunov[row * grid.s.count + i] = lyapunovExponent(s, b, r, dt, transient, steps);
+      }
+   });
+}
+
+/*
+ * Raw result: "LYAP", the three ranges, then the floats in [r][b][s] order
+ */
+bool sweepWriteBinary(sweepGrid &grid, const char *path) {
+   FILE *file = fopen(path, "wb");
+   if (!file) return false;
+   fwrite("LYAP", 1, 4, file);
+   sweepRange ranges[] = {grid.s, grid.b, grid.r};
+   for (auto &range : ranges) {
+      fwrite(&range.min, sizeof(float), 1, file);
+      fwrite(&range.max, sizeof(float), 1, file);
+      fwrite(&range.count, sizeof(int), 1, file);
+   }
+   fwrite(grid.lyapunov.data(), sizeof(float), grid.lyapunov.size(), file);
+   return fclose(file) == 0;
+}
+
+/*
+ * Grayscale image, s across and r up, one panel per b side by side.
+ * Black is stable (exponent <= 0) or blown up, white the most chaotic cell.
+ */
+bool sweepWritePGM(sweepGrid &grid, const char *path) {
+   float most = 0;
+   for (float value : grid.lyapunov) {
+      if (value > most) most = value;
+   }
+
+   int width = grid.s.count * grid.b.count, height = grid.r.count;
+   std::vector<unsigned char> image(width * height);
+   for (int ri = 0; ri < grid.r.count; ri++) {
+      for (int bi = 0; bi < grid.b.count; bi++) {
+         for (int si = 0; si < grid.s.count; si++) {
+            float value = grid.lyapunov[(ri * grid.b.count + bi) * grid.s.count + si];
+            float shade = (value > 0 && most > 0) ? value / most : 0;
+            image[(height - 1 - ri) * width + bi * grid.s.count + si] = shade * 255 + .5f;
+         }
+      }
+   }
+
+   FILE *file = fopen(path, "wb");
+   if (!file) return false;
+   fprintf(file, "P5\n%d %d\n255\n", width, height);
+   fwrite(image.data(), 1, image.size(), file);
+   return fclose(file) == 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * The attractors on offer. Each system is a type with a static, templated
+ * derivative, so an integrator or ensemble kernel instantiated on it gets
+ * the equations inlined at whatever width it runs, float or SIMD, with no
+ * dispatch inside the stepping loop. Parameters come in as an array k.
+ */
+
+enum attractorKind {
+   LORENZ,
+   ROSSLER,
+   THOMAS,
+   AIZAWA,
+};
+
+const int attractorCount = 4;
+
+// k = {s, b, r}
+struct lorenzSystem {
+   template <class T>
+   static inline void derivative(const T p[3], const float k[], T d[3]) {
+      d[0] = T(k[0])*(p[1]-p[0]);
+      d[1] = p[0]*(T(k[2])-p[2])-p[1];
+      d[2] = p[0]*p[1] - T(k[1])*p[2];
+   }
+};
+
+// k = {a, b, c}
+struct rosslerSystem {
+   template <class T>
+   static inline void derivative(const T p[3], const float k[], T d[3]) {
+      d[0] = -p[1] - p[2];
+      d[1] = p[0] + T(k[0])*p[1];
+      d[2] = T(k[1]) + p[2]*(p[0] - T(k[2]));
+   }
+};
+
+// k = {b}, cyclically symmetric
+struct thomasSystem {
+   template <class T>
+   static inline void derivative(const T p[3], const float k[], T d[3]) {
+      d[0] = sinOf(p[1]) - T(k[0])*p[0];
+      d[1] = sinOf(p[2]) - T(k[0])*p[1];
+      d[2] = sinOf(p[0]) - T(k[0])*p[2];
+   }
+};
+
+// k = {a, b, c, d, e, f}
+struct aizawaSystem {
+   template <class T>
+   static inline void derivative(const T p[3], const float k[], T d[3]) {
+      T zb = p[2] - T(k[1]);
+      T radius = p[0]*p[0] + p[1]*p[1];
+      d[0] = zb*p[0] - T(k[3])*p[1];
+      d[1] = T(k[3])*p[0] + zb*p[1];
+      d[2] = T(k[2]) + T(k[0])*p[2] - p[2]*p[2]*p[2]*T(1.f/3) - radius*(T(1) + T(k[4])*p[2]) + T(k[5])*p[2]*p[0]*p[0]*p[0];
+   }
+};
+
+/*
+ * One explicit Euler step of p, leaving the squared speed at the start
+ * in velocity. For lorenzSystem this is marchPoint exactly.
+ */
+template <class System, class T>
+inline void eulerStep(T p[3], T &velocity, double dt, const float k[]) {
+   T d[3];
+   System::derivative(p, k, d);
+   velocity = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+   for (int i = 0; i < 3; i++) p[i] = p[i] + T(dt)*d[i];
+}
+
+template <class System>
+lorenzPoint eulerPoint(lorenzPoint &point, float dt, const float k[]) {
+   float p[3] = {point.x, point.y, point.z};
+   float velocity;
+   eulerStep<System>(p, velocity, dt, k);
+   return lorenzPoint {p[0], p[1], p[2], velocity};
+}
+
+// What the app needs to show a system; none of it is touched while stepping
+struct attractorInfo {
+   const char *name;
+   // labels for the parameters the keyboard adjusts, NULL past the last
+   const char *paramNames[3];
+   float params[6];
+   // change per keypress
+   float sensitivity;
+   lorenzPoint start;
+   // scene scale that fits it in view, and simulation speed relative to Lorenz
+   float scale;
+   float pace;
+};
+
+const attractorInfo attractors[attractorCount] = {
+   {"Lorenz", {"S", "B", "R"}, {10, 2.6667, 28}, .33, {10, 12, 25, 0}, .03, 1},
+   {"Rossler", {"A", "B", "C"}, {.2, .2, 5.7}, .02, {1, 1, 0, 0}, .08, 5},
+   {"Thomas", {"B", NULL, NULL}, {.208186}, .005, {.1, 0, 0, 0}, .3, 20},
+   {"Aizawa", {"A", "B", "C"}, {.95, .7, .6, 3.5, .25, .1}, .02, {.1, 0, 0, 0}, .9, 3},
+};
@@ -0,0 +1,106 @@
+/*
+ * GPU copy of the trajectory history, drawn as a line strip.
+ * Only points added since the last sync are uploaded, so a frame costs
+ * O(new points) no matter how long the history is.
+ */
+
+#include <vector>
+#include <cstddef>
+
+struct trailBuffer {
+   // mirrors the ring slot for slot, plus a copy of slot 0 at the end so
+   // the strip can run across the wraparound
+   unsigned int pointBuffer = 0;
+   long capacity = 0;
+   // ring.total at the last sync
+   long uploaded = 0;
+   // points the buffer holds, and the slot of the oldest
+   long count = 0;
+   long oldest = 0;
+   // velocity.vert, which maps velocity to color on the GPU
+   int program = 0;
+   int velocityAttribute = -1;
+};
+
+void trailReset(trailBuffer &trail) {
+   trail.uploaded = 0;
+   trail.count = 0;
+   trail.oldest = 0;
+}
+
+void trailInit(trailBuffer &trail) {
+   glGenBuffers(1, &trail.pointBuffer);
+   trail.program = CreateShaderProg("velocity.vert", NULL);
+   trail.velocityAttribute = glGetAttribLocation(trail.program, "Velocity");
+}
+
+// Upload ring slots [first, last), no wrapping
+static void trailUploadSlots(trailBuffer &trail, pointRing &ring, long first, long last) {
+   if (last <= first) return;
+   glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(lorenzPoint), (last - first) * sizeof(lorenzPoint), &ring.slots[first]);
+   if (first == 0) {
+      glBufferSubData(GL_ARRAY_BUFFER, trail.capacity * sizeof(lorenzPoint), sizeof(lorenzPoint), &ring.slots[0]);
+   }
+}
+
+/*
+ * Bring the GPU copy up to date with the ring, uploading only the slots
+ * written since the last sync, in at most two pieces when they wrap
+ */
+void trailSync(trailBuffer &trail, pointRing &ring) {
+   glBindBuffer(GL_ARRAY_BUFFER, trail.pointBuffer);
+   if (trail.capacity != ring.capacity) {
+      trail.capacity = ring.capacity;
+      glBufferData(GL_ARRAY_BUFFER, (trail.capacity + 1) * sizeof(lorenzPoint), NULL, GL_DYNAMIC_DRAW);
+      trail.uploaded = 0;
+   }
+
+   long fresh = std::min(ring.total - trail.uploaded, ring.capacity);
+   if (fresh > 0) {
+      long first = (ring.total - fresh) % ring.capacity;
+      long last = first + fresh;
+      trailUploadSlots(trail, ring, first, std::min(last, ring.capacity));
+      trailUploadSlots(trail, ring, 0, last - ring.capacity);
+   }
+
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   trail.uploaded = ring.total;
+   trail.count = ringSize(ring);
+   trail.oldest = ringOldest(ring);
+}
+
+/*
+ * Colors come from the velocity range, so moving vMin or vMax is just a
+ * uniform change rather than a pass over every point
+ */
+void trailDraw(trailBuffer &trail, float vMin, float vMax) {
+   if (trail.count < 2) return;
+
+   glUseProgram(trail.program);
+   glUniform1f(glGetUniformLocation(trail.program, "vMin"), vMin);
+   glUniform1f(glGetUniformLocation(trail.program, "vMax"), vMax);
+
+   glBindBuffer(GL_ARRAY_BUFFER, trail.pointBuffer);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glVertexPointer(3, GL_FLOAT, sizeof(lorenzPoint), 0);
+   glEnableVertexAttribArray(trail.velocityAttribute);
+   glVertexAttribPointer(trail.velocityAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(lorenzPoint), (void *)offsetof(lorenzPoint, velocity));
+
+   // a flat shaded strip takes each segment's color from its second point,
+   // as the per segment GL_LINES did
+   glShadeModel(GL_FLAT);
+   long end = trail.oldest + trail.count;
+   if (end <= trail.capacity + 1) {
+      glDrawArrays(GL_LINE_STRIP, trail.oldest, trail.count);
+   } else {
+      // oldest through the end and on into the copy of slot 0, then slot 0 to the newest
+      glDrawArrays(GL_LINE_STRIP, trail.oldest, trail.capacity + 1 - trail.oldest);
+      glDrawArrays(GL_LINE_STRIP, 0, end - trail.capacity);
+   }
+   glShadeModel(GL_SMOOTH);
+
+   glDisableVertexAttribArray(trail.velocityAttribute);
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glUseProgram(0);
+}
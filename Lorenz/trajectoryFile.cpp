@@ -0,0 +1,151 @@
+/*
+ * Trajectories on disk: a small header recording the parameters, then
+ * raw lorenzPoint records. Written in chunks so a run never has to fit in
+ * memory, and read back through a memory map so replay copies nothing.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct trajectoryHeader {
+   char magic[4];
+   uint32_t version;
+   float s, b, r, dt;
+   // records that follow; 0 if the writer never finished
+   uint64_t count;
+};
+
+// ------------ Writing ------------ //
+
+struct trajectoryWriter {
+   FILE *file = NULL;
+   trajectoryHeader header;
+   std::vector<lorenzPoint> chunk;
+};
+
+bool writerOpen(trajectoryWriter &writer, const char *path, float s, float b, float r, float dt) {
+   writer.file = fopen(path, "wb");
+   if (!writer.file) return false;
+
+   writer.header = trajectoryHeader {{'L', 'R', 'Z', 'T'}, 1, s, b, r, dt, 0};
+   writer.chunk.reserve(1 << 16);
+   return fwrite(&writer.header, sizeof(trajectoryHeader), 1, writer.file) == 1;
+}
+
+static bool writerFlush(trajectoryWriter &writer) {
+   size_t written = fwrite(writer.chunk.data(), sizeof(lorenzPoint), writer.chunk.size(), writer.file);
+   bool ok = written == writer.chunk.size();
+   writer.header.count += written;
+   writer.chunk.clear();
+   return ok;
+}
+
+bool writerPush(trajectoryWriter &writer, lorenzPoint point) {
+   writer.chunk.push_back(point);
+   if (writer.chunk.size() == writer.chunk.capacity()) {
+      return writerFlush(writer);
+   }
+   return true;
+}
+
+// Flush, then go back and record the final count in the header
+bool writerClose(trajectoryWriter &writer) {
+   bool ok = writerFlush(writer);
+   ok = ok && fseek(writer.file, 0, SEEK_SET) == 0;
+   ok = ok && fwrite(&writer.header, sizeof(trajectoryHeader), 1, writer.file) == 1;
+   ok = (fclose(writer.file) == 0) && ok;
+   writer.file = NULL;
+   return ok;
+}
+
+/*
+ * generate(), streamed to path instead of returned in one allocation
+ */
+bool generateToFile(const char *path, long amount, float s, float b, float r, float dt) {
+   trajectoryWriter writer;
+   if (!writerOpen(writer, path, s, b, r, dt)) return false;
+
+   lorenzPoint point = {1, 1, 1, 0};
+   bool ok = true;
+   for (long i = 0; i < amount && ok; i++) {
+      ok = writerPush(writer, point);
+      // marchPoint is generate()'s loop body, velocity included
+      point = marchPoint(point, dt, s, b, r);
+   }
+   return writerClose(writer) && ok;
+}
+
+// ------------ Reading ------------ //
+
+struct trajectoryFile {
+   trajectoryHeader header;
+   // records, straight out of the mapping
+   const lorenzPoint *points = NULL;
+   uint64_t count = 0;
+
+   void *mapping = NULL;
+   size_t length = 0;
+#ifdef _WIN32
+   HANDLE file = INVALID_HANDLE_VALUE;
+   HANDLE map = NULL;
+#endif
+};
+
+/*
+ * Map path read only. Records are paged in by the OS as they are touched,
+ * so files far larger than memory can be replayed.
+ */
+bool trajectoryMap(trajectoryFile &trajectory, const char *path) {
+#ifdef _WIN32
+   trajectory.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (trajectory.file == INVALID_HANDLE_VALUE) return false;
+   LARGE_INTEGER size;
+   GetFileSizeEx(trajectory.file, &size);
+   trajectory.length = size.QuadPart;
+   trajectory.map = CreateFileMappingA(trajectory.file, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (trajectory.map) trajectory.mapping = MapViewOfFile(trajectory.map, FILE_MAP_READ, 0, 0, 0);
+#else
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) return false;
+   struct stat info;
+   if (fstat(fd, &info) == 0) {
+      trajectory.length = info.st_size;
+      trajectory.mapping = mmap(NULL, trajectory.length, PROT_READ, MAP_SHARED, fd, 0);
+      if (trajectory.mapping == MAP_FAILED) trajectory.mapping = NULL;
+   }
+   // the mapping stays valid without the descriptor
+   close(fd);
+#endif
+
+   if (!trajectory.mapping || trajectory.length < sizeof(trajectoryHeader)) return false;
+   memcpy(&trajectory.header, trajectory.mapping, sizeof(trajectoryHeader));
+   if (memcmp(trajectory.header.magic, "LRZT", 4) != 0) return false;
+
+   // trust the file size over an unfinished header
+   uint64_t present = (trajectory.length - sizeof(trajectoryHeader)) / sizeof(lorenzPoint);
+   trajectory.count = trajectory.header.count && trajectory.header.count < present ? trajectory.header.count : present;
+   trajectory.points = (const lorenzPoint *)((const char *)trajectory.mapping + sizeof(trajectoryHeader));
+   return true;
+}
+
+void trajectoryUnmap(trajectoryFile &trajectory) {
+#ifdef _WIN32
+   if (trajectory.mapping) UnmapViewOfFile(trajectory.mapping);
+   if (trajectory.map) CloseHandle(trajectory.map);
+   if (trajectory.file != INVALID_HANDLE_VALUE) CloseHandle(trajectory.file);
+#else
+   if (trajectory.mapping) munmap(trajectory.mapping, trajectory.length);
+#endif
+   trajectory = trajectoryFile();
+}
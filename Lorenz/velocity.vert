@@ -0,0 +1,20 @@
+//  Velocity colormap shader
+#version 120
+
+//  Range of velocities seen so far
+uniform float vMin;
+uniform float vMax;
+//  Raw velocity of this point
+attribute float Velocity;
+
+void main()
+{
+   //  Normalized velocity picks the hue, as velocityToColor did
+   float t = (vMax > vMin) ? (Velocity - vMin) / (vMax - vMin) : 0.0;
+   //  HSV to RGB with full saturation and value
+   float h = mod(t * 6.0, 6.0);
+   vec3 rgb = clamp(abs(mod(h + vec3(0.0, 4.0, 2.0), 6.0) - 3.0) - 1.0, 0.0, 1.0);
+   //  Built in color, so flat shading still applies
+   gl_FrontColor = vec4(rgb, 1.0);
+   gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+}
@@ -1,4 +1,6 @@
 #include <vector>
+#include <cstddef>
+#include <algorithm>
 #ifdef USEGLEW
 #include <GL/glew.h>
 #endif
@@ -10,9 +12,135 @@
 #endif
 
 #include "geometry.h"
+#include "render.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+// ------ Mat4 ------ //
+
+Mat4 Mat4::identity()
+{
+    return Mat4{{
+        1, 0, 0, 0, // x
+        0, 1, 0, 0, // y
+        0, 0, 1, 0, // z
+        0, 0, 0, 1, // w
+    }};
+}
+
+/// @brief Same matrix glTranslatef would multiply by
+Mat4 Mat4::translation(Vec3 offset)
+{
+    auto result = identity();
+    result.m[12] = offset.x;
+    result.m[13] = offset.y;
+    result.m[14] = offset.z;
+    return result;
+}
+
+/// @brief Same matrix glScalef would multiply by
+Mat4 Mat4::scaling(Vec3 scale)
+{
+    auto result = identity();
+    result.m[0] = scale.x;
+    result.m[5] = scale.y;
+    result.m[10] = scale.z;
+    return result;
+}
+
+/// @brief Same matrix glOrtho would multiply by
+Mat4 Mat4::orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    auto result = identity();
+    result.m[0] = 2 / (right - left);
+    result.m[5] = 2 / (top - bottom);
+    result.m[10] = -2 / (zFar - zNear);
+    result.m[12] = -(right + left) / (right - left);
+    result.m[13] = -(top + bottom) / (top - bottom);
+    result.m[14] = -(zFar + zNear) / (zFar - zNear);
+    return result;
+}
+
+Mat4 Mat4::frustum(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    auto result = identity();
+    result.m[0] = 2 * zNear / (right - left);
+    result.m[5] = 2 * zNear / (top - bottom);
+    result.m[8] = (right + left) / (right - left);
+    result.m[9] = (top + bottom) / (top - bottom);
+    result.m[10] = -(zFar + zNear) / (zFar - zNear);
+    result.m[11] = -1;
+    result.m[14] = -2 * zFar * zNear / (zFar - zNear);
+    result.m[15] = 0;
+    return result;
+}
+
+/// @brief Same matrix glRotatef would multiply by
+Mat4 Mat4::rotation(float degrees, Vec3 axis)
+{
+    auto n = axis.normalized();
+    float radians = degrees * M_PI / 180;
+    float c = cos(radians);
+    float s = sin(radians);
+    float t = 1 - c;
+
+    return Mat4{{
+        n.x * n.x * t + c, n.y * n.x * t + n.z * s, n.x * n.z * t - n.y * s, 0,
+        n.x * n.y * t - n.z * s, n.y * n.y * t + c, n.y * n.z * t + n.x * s, 0,
+        n.x * n.z * t + n.y * s, n.y * n.z * t - n.x * s, n.z * n.z * t + c, 0,
+        0, 0, 0, 1,
+    }};
+}
+
+Mat4 Mat4::operator*(Mat4 other)
+{
+    Mat4 result;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            float sum = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                sum += m[k * 4 + row] * other.m[col * 4 + k];
+            }
+            result.m[col * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+Vec3 Mat4::transformPoint(Vec3 p)
+{
+    return {
+        m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+        m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+        m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14],
+    };
+}
+
+/// @brief Transform ignoring translation
+Vec3 Mat4::transformDirection(Vec3 d)
+{
+    return {
+        m[0] * d.x + m[4] * d.y + m[8] * d.z,
+        m[1] * d.x + m[5] * d.y + m[9] * d.z,
+        m[2] * d.x + m[6] * d.y + m[10] * d.z,
+    };
+}
 
 // ------ BoundingBox ------ //
 
+BoundingBox BoundingBox::empty()
+{
+    return BoundingBox{
+        {INFINITY, INFINITY, INFINITY},
+        {-INFINITY, -INFINITY, -INFINITY},
+    };
+}
+
 Vec3 BoundingBox::center()
 {
     return (min + max) / 2;
@@ -23,6 +151,79 @@ Vec3 BoundingBox::size()
     return max - min;
 }
 
+bool BoundingBox::isEmpty()
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+BoundingBox BoundingBox::merged(BoundingBox other)
+{
+    return BoundingBox{
+        {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)},
+        {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)},
+    };
+}
+
+/// @brief Axis aligned box enclosing this box after a transform
+BoundingBox BoundingBox::transformed(Mat4 matrix)
+{
+    if (isEmpty())
+    {
+        return *this;
+    }
+
+    // transform the center, then project the half extents onto each axis
+    auto halfSize = size() / 2;
+    auto c = matrix.transformPoint(center());
+    auto m = matrix.m;
+    Vec3 extent = {
+        fabsf(m[0]) * halfSize.x + fabsf(m[4]) * halfSize.y + fabsf(m[8]) * halfSize.z,
+        fabsf(m[1]) * halfSize.x + fabsf(m[5]) * halfSize.y + fabsf(m[9]) * halfSize.z,
+        fabsf(m[2]) * halfSize.x + fabsf(m[6]) * halfSize.y + fabsf(m[10]) * halfSize.z,
+    };
+
+    return BoundingBox{c - extent, c + extent};
+}
+
+// ------ Drawable ------ //
+
+BoundingBox Drawable::bounds()
+{
+    if (boundsDirty)
+    {
+        cachedBounds = computeBounds();
+        boundsDirty = false;
+    }
+    return cachedBounds;
+}
+
+BoundingBox Drawable::worldBounds()
+{
+    if (worldBoundsDirty)
+    {
+        cachedWorldBounds = parent ? bounds().transformed(parent->worldMatrix()) : bounds();
+        worldBoundsDirty = false;
+    }
+    return cachedWorldBounds;
+}
+
+void Drawable::invalidateBounds()
+{
+    // a dirty node always has dirty ancestors, so stop at the first one
+    boundsDirty = true;
+    worldBoundsDirty = true;
+    for (Drawable *node = parent; node && !node->boundsDirty; node = node->parent)
+    {
+        node->boundsDirty = true;
+        node->worldBoundsDirty = true;
+    }
+}
+
+void Drawable::invalidateWorld()
+{
+    worldBoundsDirty = true;
+}
+
 // ---- Vec3 ---- //
 
 Vec3 Vec3::operator+(Vec3 other)
@@ -75,6 +276,23 @@ Vec3 Vec3::reciprocal()
     return {1 / x, 1 / y, 1 / z};
 };
 
+Vec3 Vec3::cross(Vec3 other)
+{
+    return {
+        y * other.z - z * other.y,
+        z * other.x - x * other.z,
+        x * other.y - y * other.x,
+    };
+};
+
+/// @brief Convert the vector to array of length 4.
+/// Initialized on the heap, so it must be deleted.
+/// @return 
+float* Vec3::toArray()
+{
+    return new float[4] {x, y, z, 1};
+};
+
 // ---- Polygon ---- //
 
 Polygon::Polygon(std::vector<Vec3> vertices, Vec3 color)
@@ -87,6 +305,13 @@ Polygon::Polygon(std::vector<Vec3> vertices, Vec3 color)
     verticies.push_back(vertices[0]);
     this->verticies = vertices;
     this->color = color;
+    
+    // calculate the normal
+    
+    auto v1 = vertices[1] - vertices[0];
+    auto v2 = vertices[2] - vertices[0];
+    auto normal = v1.cross(v2);
+    this->normal = normal.normalized();
 }
 
 Polygon::Polygon(std::vector<Vec3> vertices) : Polygon(vertices, {1, 1, 1}) {}
@@ -136,7 +361,7 @@ Prism* Polygon::extrude(Vec3 extrusion)
     return new Prism(*this, extrusion);
 }
 
-BoundingBox Polygon::bounds()
+BoundingBox Polygon::computeBounds()
 {
     auto min = Vec3{INFINITY, INFINITY, INFINITY};
     auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
@@ -158,14 +383,42 @@ BoundingBox Polygon::bounds()
 void Polygon::draw()
 {
     glColor3f(color.x, color.y, color.z);
+    glNormal3f(normal.x, normal.y, normal.z);
+    
     glBegin(GL_POLYGON);
     for (Vec3 vertex : verticies)
     {
         glVertex3f(vertex.x, vertex.y, vertex.z);
     }
+    
     glEnd();
 }
 
+void Polygon::bakeInto(BakedMesh *mesh, Mat4 matrix)
+{
+    auto transformed = std::vector<Vec3>();
+    transformed.reserve(verticies.size());
+    for (Vec3 vertex : verticies)
+    {
+        transformed.push_back(matrix.transformPoint(vertex));
+    }
+
+    // recompute rather than transform the normal so non-uniform scales stay correct
+    auto v1 = transformed[1] - transformed[0];
+    auto v2 = transformed[2] - transformed[0];
+    mesh->addPolygon(transformed, v1.cross(v2).normalized(), color);
+}
+
+void Polygon::render(RenderBackend *backend)
+{
+    backend->drawPolygon(*this);
+}
+
+int Polygon::drawCalls()
+{
+    return 1;
+}
+
 // ---- Frustum ---- //
 
 Frustum::Frustum(Polygon base1, Polygon base2, Vec3 color)
@@ -244,12 +497,12 @@ std::vector<Polygon> Frustum::getPolygons()
     return polygons;
 }
 
-BoundingBox Frustum::bounds()
+BoundingBox Frustum::computeBounds()
 {
     auto min = Vec3{INFINITY, INFINITY, INFINITY};
     auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
 
-    for (Polygon polygon : polygons)
+    for (Polygon &polygon : polygons)
     {
         auto polyBounds = polygon.bounds();
         auto polyMin = polyBounds.min;
@@ -267,6 +520,27 @@ BoundingBox Frustum::bounds()
     return BoundingBox{min, max};
 }
 
+void Frustum::bakeInto(BakedMesh *mesh, Mat4 matrix)
+{
+    for (Polygon &polygon : polygons)
+    {
+        polygon.bakeInto(mesh, matrix);
+    }
+}
+
+void Frustum::render(RenderBackend *backend)
+{
+    for (Polygon &polygon : polygons)
+    {
+        polygon.render(backend);
+    }
+}
+
+int Frustum::drawCalls()
+{
+    return polygons.size();
+}
+
 Box* Frustum::boxed()
 {
     return new Box({this});
@@ -282,18 +556,20 @@ Prism::Prism(Polygon base1, Vec3 extrusion, Vec3 color) : Frustum(base1, base1.r
 // container
 Box::Box(std::vector<Drawable *> children)
 {
-    this->children = children;
     this->identity();
+    for (Drawable *child : children)
+    {
+        this->add(child);
+    }
 }
 
 Box::Box(std::initializer_list<Drawable *> children)
 {
-    this->children = std::vector<Drawable *>();
+    this->identity();
     for (Drawable *child : children)
     {
-        this->children.push_back(child);
+        this->add(child);
     }
-    this->identity();
 }
 
 Box::~Box()
@@ -304,51 +580,88 @@ Box::~Box()
     }
 }
 
-void Box::identity()
+void Box::add(Drawable *child)
 {
-    float matrix[16] = {
-        1, 0, 0, 0, // x
-        0, 1, 0, 0, // y
-        0, 0, 1, 0, // z
-        0, 0, 0, 1, // w
-    };
+    children.push_back(child);
+    child->parent = this;
+    child->invalidateWorld();
+    this->invalidateBounds();
+}
 
-    for (int i = 0; i < 16; i++)
+/// @brief Detach a child without deleting it
+void Box::remove(Drawable *child)
+{
+    for (unsigned int i = 0; i < children.size(); i++)
     {
-        this->matrix[i] = matrix[i];
+        if (children[i] == child)
+        {
+            children.erase(children.begin() + i);
+            child->parent = nullptr;
+            child->invalidateWorld();
+            this->invalidateBounds();
+            return;
+        }
     }
+}
 
+void Box::identity()
+{
+    this->matrix = Mat4::identity();
     this->scaleFactor = {1, 1, 1};
+    this->matrixChanged();
 }
 
-BoundingBox Box::bounds()
+/// @brief The local matrix changed: bounds above and world caches below are stale
+void Box::matrixChanged()
 {
-    auto min = Vec3{INFINITY, INFINITY, INFINITY};
-    auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
+    this->invalidateBounds();
+    this->invalidateWorld();
+}
 
-    for (Drawable *child : children)
+Mat4 Box::worldMatrix()
+{
+    if (worldMatrixDirty)
     {
-        auto bounds = child->bounds();
-        auto childMin = bounds.min;
-        auto childMax = bounds.max;
+        cachedWorldMatrix = parent ? parent->worldMatrix() * matrix : matrix;
+        worldMatrixDirty = false;
+    }
+    return cachedWorldMatrix;
+}
 
-        min.x = std::min(min.x, childMin.x);
-        min.y = std::min(min.y, childMin.y);
-        min.z = std::min(min.z, childMin.z);
+void Box::invalidateWorld()
+{
+    Drawable::invalidateWorld();
 
-        max.x = std::max(max.x, childMax.x);
-        max.y = std::max(max.y, childMax.y);
-        max.z = std::max(max.z, childMax.z);
+    // a dirty world matrix implies a dirty subtree, so stop early
+    if (worldMatrixDirty)
+    {
+        return;
     }
 
-    return BoundingBox{min, max};
+    worldMatrixDirty = true;
+    for (Drawable *child : children)
+    {
+        child->invalidateWorld();
+    }
+}
+
+/// @brief Children's bounds, moved into the parent's space by this box's matrix
+BoundingBox Box::computeBounds()
+{
+    auto bounds = BoundingBox::empty();
+    for (Drawable *child : children)
+    {
+        bounds = bounds.merged(child->bounds());
+    }
+
+    return bounds.transformed(matrix);
 }
 
 void Box::draw()
 {
     glPushMatrix();
 
-    glMultMatrixf(this->matrix);
+    glMultMatrixf(this->matrix.m);
     
     // center the box
     // auto size = this->bounds().size();
@@ -362,14 +675,52 @@ void Box::draw()
     glPopMatrix();
 }
 
+void Box::bakeInto(BakedMesh *mesh, Mat4 matrix)
+{
+    auto composed = matrix * this->matrix;
+
+    for (Drawable *child : children)
+    {
+        child->bakeInto(mesh, composed);
+    }
+}
+
+int Box::drawCalls()
+{
+    int calls = 0;
+    for (Drawable *child : children)
+    {
+        calls += child->drawCalls();
+    }
+    return calls;
+}
+
+void Box::render(RenderBackend *backend)
+{
+    backend->pushMatrix();
+    backend->multMatrix(matrix);
+    for (Drawable *child : children)
+    {
+        child->render(backend);
+    }
+    backend->popMatrix();
+}
+
+/// @brief Flatten this hierarchy into a single static mesh.
+/// The box is left untouched and may be deleted afterwards.
+BakedMesh* Box::baked()
+{
+    auto mesh = new BakedMesh();
+    this->bakeInto(mesh, Mat4::identity());
+    mesh->savedDrawCalls = this->drawCalls() - mesh->drawCalls();
+    return mesh;
+}
+
 Box* Box::scale(Vec3 scale)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glScalef(scale.x, scale.y, scale.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::scaling(scale);
     this->scaleFactor = this->scaleFactor.multComps(scale);
+    this->matrixChanged();
     return this;
 }
 
@@ -380,22 +731,372 @@ Box* Box::scale(float scale) {
 Box* Box::move(Vec3 pos)
 {
     pos = pos.multComps(this->scaleFactor.reciprocal());
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glTranslatef(pos.x, pos.y, pos.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::translation(pos);
+    this->matrixChanged();
     return this;
 }
 
 Box* Box::rotate(Vec3 rot)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glRotatef(rot.x, 1, 0, 0);
-    glRotatef(rot.y, 0, 1, 0);
-    glRotatef(rot.z, 0, 0, 1);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix
+                 * Mat4::rotation(rot.x, {1, 0, 0})
+                 * Mat4::rotation(rot.y, {0, 1, 0})
+                 * Mat4::rotation(rot.z, {0, 0, 1});
+    this->matrixChanged();
     return this;
+}
+
+// -------- BakedMesh -------- //
+
+BakedMesh::BakedMesh() {}
+
+BakedMesh::~BakedMesh()
+{
+    if (vertexBuffer)
+    {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+}
+
+/// @brief Append a convex polygon as a triangle fan
+void BakedMesh::addPolygon(std::vector<Vec3> &polygon, Vec3 normal, Vec3 color)
+{
+    unsigned int base = verticies.size();
+    for (Vec3 vertex : polygon)
+    {
+        verticies.push_back({vertex, normal, color});
+    }
+
+    for (unsigned int i = 1; i + 1 < polygon.size(); i++)
+    {
+        indices.push_back(base);
+        indices.push_back(base + i);
+        indices.push_back(base + i + 1);
+    }
+}
+
+void BakedMesh::upload()
+{
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, verticies.size() * sizeof(BakedVertex), verticies.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+}
+
+void BakedMesh::draw()
+{
+    if (!vertexBuffer)
+    {
+        upload();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(BakedVertex), (void *)offsetof(BakedVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(BakedVertex), (void *)offsetof(BakedVertex, normal));
+    glColorPointer(3, GL_FLOAT, sizeof(BakedVertex), (void *)offsetof(BakedVertex, color));
+
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+BoundingBox BakedMesh::computeBounds()
+{
+    auto min = Vec3{INFINITY, INFINITY, INFINITY};
+    auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
+
+    for (BakedVertex &vertex : verticies)
+    {
+        min.x = std::min(min.x, vertex.position.x);
+        min.y = std::min(min.y, vertex.position.y);
+        min.z = std::min(min.z, vertex.position.z);
+
+        max.x = std::max(max.x, vertex.position.x);
+        max.y = std::max(max.y, vertex.position.y);
+        max.z = std::max(max.z, vertex.position.z);
+    }
+
+    return BoundingBox{min, max};
+}
+
+void BakedMesh::bakeInto(BakedMesh *mesh, Mat4 matrix)
+{
+    unsigned int base = mesh->verticies.size();
+    for (BakedVertex vertex : verticies)
+    {
+        auto normal = matrix.transformDirection(vertex.normal);
+        mesh->verticies.push_back({matrix.transformPoint(vertex.position), normal.normalized(), vertex.color});
+    }
+
+    for (unsigned int index : indices)
+    {
+        mesh->indices.push_back(base + index);
+    }
+}
+
+void BakedMesh::render(RenderBackend *backend)
+{
+    backend->drawMesh(*this);
+}
+
+int BakedMesh::drawCalls()
+{
+    return 1;
+}
+
+// -------- ViewFrustum -------- //
+
+ViewFrustum ViewFrustum::fromMatrix(Mat4 clip)
+{
+    // Gribb/Hartmann: each plane is the w row plus or minus another row
+    auto m = clip.m;
+    ViewFrustum frustum;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            float sign = side == 0 ? 1 : -1;
+            float *plane = frustum.planes[i * 2 + side];
+            for (int col = 0; col < 4; col++)
+            {
+                plane[col] = m[col * 4 + 3] + sign * m[col * 4 + i];
+            }
+        }
+    }
+    return frustum;
+}
+
+ViewFrustum ViewFrustum::current()
+{
+    Mat4 projection, modelview;
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+    return fromMatrix(projection * modelview);
+}
+
+int ViewFrustum::classify(BoundingBox box)
+{
+    int result = 2;
+    for (auto &plane : planes)
+    {
+        // the corner furthest along the plane normal, and the one nearest
+        Vec3 far = {
+            plane[0] >= 0 ? box.max.x : box.min.x,
+            plane[1] >= 0 ? box.max.y : box.min.y,
+            plane[2] >= 0 ? box.max.z : box.min.z,
+        };
+        Vec3 near = {
+            plane[0] >= 0 ? box.min.x : box.max.x,
+            plane[1] >= 0 ? box.min.y : box.max.y,
+            plane[2] >= 0 ? box.min.z : box.max.z,
+        };
+
+        if (plane[0] * far.x + plane[1] * far.y + plane[2] * far.z + plane[3] < 0)
+        {
+            return 0;
+        }
+        if (plane[0] * near.x + plane[1] * near.y + plane[2] * near.z + plane[3] < 0)
+        {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// -------- BVH -------- //
+
+// leaves per BVH node before it is split
+#define BVH_LEAF_SIZE 4
+
+BVH::BVH(Box *root)
+{
+    this->root = root;
+    rebuild();
+}
+
+void BVH::rebuild()
+{
+    leaves.clear();
+    nodes.clear();
+    collect(root);
+    if (!leaves.empty())
+    {
+        build(0, leaves.size());
+    }
+    invalidateBounds();
+}
+
+int BVH::leafCount()
+{
+    return leaves.size();
+}
+
+void BVH::collect(Drawable *drawable)
+{
+    auto box = dynamic_cast<Box *>(drawable);
+    if (box)
+    {
+        for (Drawable *child : box->children)
+        {
+            collect(child);
+        }
+        return;
+    }
+
+    auto matrix = drawable->parent ? drawable->parent->worldMatrix() : Mat4::identity();
+    leaves.push_back({drawable, matrix, drawable->worldBounds()});
+}
+
+/// @brief Median split along the longest axis of the leaf centers
+int BVH::build(int first, int count)
+{
+    int index = nodes.size();
+    nodes.push_back(Node{BoundingBox::empty(), -1, -1, first, count});
+
+    auto bounds = BoundingBox::empty();
+    auto centers = BoundingBox::empty();
+    for (int i = first; i < first + count; i++)
+    {
+        bounds = bounds.merged(leaves[i].bounds);
+        auto center = leaves[i].bounds.center();
+        centers = centers.merged({center, center});
+    }
+    nodes[index].bounds = bounds;
+
+    if (count <= BVH_LEAF_SIZE)
+    {
+        return index;
+    }
+
+    auto size = centers.size();
+    int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    auto axisOf = [axis](Leaf &leaf) {
+        auto center = leaf.bounds.center();
+        return axis == 0 ? center.x : axis == 1 ? center.y : center.z;
+    };
+
+    int half = count / 2;
+    std::nth_element(leaves.begin() + first, leaves.begin() + first + half, leaves.begin() + first + count,
+                     [&axisOf](Leaf &a, Leaf &b) { return axisOf(a) < axisOf(b); });
+
+    // nodes may reallocate while building children, so assign after
+    int left = build(first, half);
+    int right = build(first + half, count - half);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+void BVH::draw()
+{
+    draw(ViewFrustum::current());
+}
+
+void BVH::draw(ViewFrustum frustum)
+{
+    GLBackend gl;
+    render(&gl, frustum);
+}
+
+void BVH::render(RenderBackend *backend)
+{
+    stats = CullStats();
+    for (Leaf &leaf : leaves)
+    {
+        backend->pushMatrix();
+        backend->multMatrix(leaf.matrix);
+        leaf.drawable->render(backend);
+        backend->popMatrix();
+        stats.drawn++;
+    }
+}
+
+void BVH::render(RenderBackend *backend, ViewFrustum frustum)
+{
+    stats = CullStats();
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // (node, fully inside) pairs; inside nodes skip further tests
+    std::vector<std::pair<int, bool>> stack = {{0, false}};
+    while (!stack.empty())
+    {
+        auto top = stack.back();
+        stack.pop_back();
+        auto &node = nodes[top.first];
+        bool inside = top.second;
+
+        if (!inside)
+        {
+            stats.tested++;
+            int visibility = frustum.classify(node.bounds);
+            if (visibility == 0)
+            {
+                stats.culled++;
+                continue;
+            }
+            inside = visibility == 2;
+        }
+
+        if (node.count > 0)
+        {
+            renderLeaves(node, backend);
+        }
+        else
+        {
+            stack.push_back({node.right, inside});
+            stack.push_back({node.left, inside});
+        }
+    }
+}
+
+void BVH::renderLeaves(Node &node, RenderBackend *backend)
+{
+    for (int i = node.first; i < node.first + node.count; i++)
+    {
+        backend->pushMatrix();
+        backend->multMatrix(leaves[i].matrix);
+        leaves[i].drawable->render(backend);
+        backend->popMatrix();
+        stats.drawn++;
+    }
+}
+
+void BVH::bakeInto(BakedMesh *mesh, Mat4 matrix)
+{
+    for (Leaf &leaf : leaves)
+    {
+        leaf.drawable->bakeInto(mesh, matrix * leaf.matrix);
+    }
+}
+
+int BVH::drawCalls()
+{
+    int calls = 0;
+    for (Leaf &leaf : leaves)
+    {
+        calls += leaf.drawable->drawCalls();
+    }
+    return calls;
+}
+
+BoundingBox BVH::computeBounds()
+{
+    return nodes.empty() ? BoundingBox::empty() : nodes[0].bounds;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
+#pragma once
 #include <vector>
 #include <initializer_list>
-#include <math.h>
+#include "math.h"
 
 struct Vec3 {
     float x, y, z;
@@ -13,23 +14,74 @@ struct Vec3 {
     float magnitude();
     Vec3 normalized();
     Vec3 multComps(Vec3 other);
+    Vec3 cross(Vec3 other);
     Vec3 reciprocal();
+    float* toArray();
+};
+
+/// @brief Column-major 4x4 matrix laid out like OpenGL's, so it can be
+/// handed to glMultMatrixf directly. Composes on the CPU without a context.
+struct Mat4 {
+    float m[16];
+    static Mat4 identity();
+    static Mat4 translation(Vec3 offset);
+    static Mat4 scaling(Vec3 scale);
+    static Mat4 rotation(float degrees, Vec3 axis);
+    static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar);
+    /// @brief Same matrix glFrustum would multiply by.
+    static Mat4 frustum(float left, float right, float bottom, float top, float zNear, float zFar);
+    Mat4 operator*(Mat4 other);
+    Vec3 transformPoint(Vec3 point);
+    Vec3 transformDirection(Vec3 direction);
 };
 
 struct BoundingBox {
     Vec3 min, max;
+    static BoundingBox empty();
     Vec3 center();
     Vec3 size();
+    bool isEmpty();
+    BoundingBox merged(BoundingBox other);
+    BoundingBox transformed(Mat4 matrix);
 };
 
+class BakedMesh;
+class Box;
+class RenderBackend;
+
 struct Drawable {
+    // set by the Box that holds this drawable
+    Box *parent = nullptr;
+
     virtual void draw() = 0;
     virtual ~Drawable() {};
-    virtual BoundingBox bounds() = 0;
+    /// @brief Cached bounds in the parent's coordinate space.
+    BoundingBox bounds();
+    /// @brief Cached bounds in the root's (world) coordinate space.
+    BoundingBox worldBounds();
+    /// @brief Mark this drawable's bounds and every ancestor's as stale.
+    void invalidateBounds();
+    /// @brief Mark world-space caches stale for this drawable and its subtree.
+    virtual void invalidateWorld();
+    /// @brief Append triangulated geometry, transformed by matrix, to a baked mesh.
+    virtual void bakeInto(BakedMesh *mesh, Mat4 matrix) = 0;
+    /// @brief Number of draw calls a single draw() issues.
+    virtual int drawCalls() = 0;
+    /// @brief draw() through any backend, GL or not.
+    virtual void render(RenderBackend *backend) = 0;
+
+    protected:
+        /// @brief Uncached bounds in the parent's coordinate space.
+        virtual BoundingBox computeBounds() = 0;
+
+    private:
+        BoundingBox cachedBounds;
+        BoundingBox cachedWorldBounds;
+        bool boundsDirty = true;
+        bool worldBoundsDirty = true;
 };
 
 class Prism;
-class Box;
 
 struct Polygon : public Drawable {
     std::vector<Vec3> verticies;
@@ -44,7 +96,15 @@ struct Polygon : public Drawable {
     Polygon reversed();
     Prism* extrude(Vec3 extrusion);
     void draw();
-    BoundingBox bounds();
+    void bakeInto(BakedMesh *mesh, Mat4 matrix);
+    int drawCalls();
+    void render(RenderBackend *backend);
+    
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        Vec3 normal;
 };
 
 class Frustum : public Drawable {
@@ -56,8 +116,12 @@ class Frustum : public Drawable {
         Frustum* varigatePaint(float strength);
         void draw();
         std::vector<Polygon> getPolygons();
-        BoundingBox bounds();
+        void bakeInto(BakedMesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
         Box* boxed();
+    protected:
+        BoundingBox computeBounds();
     private:
         std::vector<Polygon> polygons;
 };
@@ -70,21 +134,130 @@ class Prism : public Frustum {
 
 class Box : public Drawable {
     private:
-        float matrix[16];
+        Mat4 matrix;
+        Mat4 cachedWorldMatrix;
+        bool worldMatrixDirty = true;
         Vec3 scaleFactor = {1, 1, 1};
+        void matrixChanged();
+
+    protected:
+        BoundingBox computeBounds();
 
     public:
+        // read freely, but modify through add/remove so cached bounds stay valid
         std::vector<Drawable*> children;
         
         Box(std::vector<Drawable*> children);
         Box(std::initializer_list<Drawable*> children);
         ~Box();
 
+        void add(Drawable *child);
+        void remove(Drawable *child);
         void identity();
-        BoundingBox bounds();
+        /// @brief Transform from this box's local space to world space.
+        Mat4 worldMatrix();
+        void invalidateWorld();
         void draw();
+        void bakeInto(BakedMesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+        BakedMesh* baked();
         Box* scale(Vec3 scale);
         Box* scale(float scale);
         Box* move(Vec3 pos);
         Box* rotate(Vec3 rot);
+};
+
+struct BakedVertex {
+    Vec3 position;
+    Vec3 normal;
+    Vec3 color;
+};
+
+/// @brief Static geometry flattened into one interleaved vertex buffer
+/// and drawn with a single indexed call. Uploaded lazily on first draw.
+class BakedMesh : public Drawable {
+    public:
+        std::vector<BakedVertex> verticies;
+        std::vector<unsigned int> indices;
+        // draw calls the source hierarchy would have issued, minus this one
+        int savedDrawCalls = 0;
+
+        BakedMesh();
+        ~BakedMesh();
+
+        void addPolygon(std::vector<Vec3> &polygon, Vec3 normal, Vec3 color);
+        void draw();
+        void bakeInto(BakedMesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        unsigned int vertexBuffer = 0;
+        unsigned int indexBuffer = 0;
+        void upload();
+};
+
+/// @brief View volume as six inward facing planes (ax + by + cz + d >= 0 inside).
+struct ViewFrustum {
+    float planes[6][4];
+    /// @brief Planes of a combined projection * modelview matrix.
+    static ViewFrustum fromMatrix(Mat4 clip);
+    /// @brief Planes of the current GL projection and modelview matrices.
+    static ViewFrustum current();
+    /// @brief 0 if outside, 1 if intersecting, 2 if fully inside.
+    int classify(BoundingBox box);
+};
+
+struct CullStats {
+    int tested = 0;
+    int culled = 0;
+    int drawn = 0;
+};
+
+/// @brief Bounding volume hierarchy over the leaves of a Box tree, built from
+/// their world bounds. Drawing skips subtrees outside the current view frustum.
+/// It is a snapshot; call rebuild() after the tree changes.
+class BVH : public Drawable {
+    public:
+        // stats from the most recent draw()
+        CullStats stats;
+        int leafCount();
+
+        BVH(Box *root);
+        void rebuild();
+        void draw();
+        void draw(ViewFrustum frustum);
+        void bakeInto(BakedMesh *mesh, Mat4 matrix);
+        int drawCalls();
+        /// @brief Every leaf, with no view to cull against.
+        void render(RenderBackend *backend);
+        /// @brief Leaves inside the frustum, as draw(frustum) but through any backend.
+        void render(RenderBackend *backend, ViewFrustum frustum);
+
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        struct Node {
+            BoundingBox bounds;
+            // children for interior nodes, leaves[first, first + count) otherwise
+            int left, right;
+            int first, count;
+        };
+        struct Leaf {
+            Drawable *drawable;
+            Mat4 matrix;
+            BoundingBox bounds;
+        };
+
+        Box *root;
+        std::vector<Node> nodes;
+        std::vector<Leaf> leaves;
+        void collect(Drawable *drawable);
+        int build(int first, int count);
+        void renderLeaves(Node &node, RenderBackend *backend);
 };
\ No newline at end of file
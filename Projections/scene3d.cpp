@@ -22,8 +22,11 @@
 #define M_PI 3.14159265
 #endif
 
+#include <chrono>
+
 #include "models/buff.h"
-// #include "geometry.h"
+#include "appLoop.h"
+#include "render.h"
 
 struct control
 {
@@ -37,6 +40,11 @@ struct control
 } control;
 
 Box *scene;
+BVH *sceneBVH;
+int herdSize = 0;
+Vec3 background;
+int headlessFrames = 0;
+const char *headlessImage = "headless.ppm";
 
 #define LEN 8192 //  Maximum length of text string
 void Print(const char *format, ...)
@@ -81,17 +89,21 @@ void draw()
       Print("Z");
    }
 
-   scene->draw();
+   sceneBVH->draw();
+
+   {
+      //----------------- Culling stats
+      glColor3f(1, 1, 1);
+      glWindowPos2i(5, 5);
+      auto stats = sceneBVH->stats;
+      Print("BVH tested %d culled %d, drew %d/%d", stats.tested, stats.culled, stats.drawn, sceneBVH->leafCount());
+   }
+
    glutSwapBuffers();
    glFlush();
    glPopMatrix();
 }
 
-// -------- Idle Hook -------- //
-void idle()
-{
-}
-
 void adjustLook(float angleX, float angleY, float angleZ)
 {
    if (control.proj != 2)
@@ -240,19 +252,9 @@ void special(int key, int x, int y)
       adjustLook(motion, 0, 0);
 }
 
-// -------- Visibility -------- //
-void visible(int vis)
-{
-   if (vis == GLUT_VISIBLE)
-      glutIdleFunc(idle);
-   else
-      glutIdleFunc(NULL);
-}
-
 void initScene()
 {
-   auto bgColor = Vec3{.4, .5, 1} / 4;
-   glClearColor(bgColor.x, bgColor.y, bgColor.z, 1);
+   background = Vec3{.4, .5, 1} / 4;
 
    auto mainBuff = buildBuff()
                        ->rotate({0, (float)(rand() % 360), 0});
@@ -291,10 +293,88 @@ void initScene()
                     ->move({-8, -2, -8});
 
    scene = new Box({mainBuff, altBuff, altBuff2, altBuff3, altBuff4, floor});
+
+   // optional generated herd to stress culling, spread on a grid around the floor
+   int side = ceil(sqrt(herdSize));
+   for (int i = 0; i < herdSize; i++)
+   {
+      float x = (i % side - side / 2) * 4;
+      float z = (i / side - side / 2) * 4;
+      scene->add(buildBuff()
+                     ->scale(.4)
+                     ->move({x, -1.3, z})
+                     ->rotate({0, (float)(rand() % 360), 0}));
+   }
+
+   sceneBVH = new BVH(scene);
+}
+
+// -------- Headless -------- //
+/// @brief Time repeated frames of the herd, still at the starting orbit, in
+/// the given projection (0 orthographic, otherwise perspective) with the BVH
+/// culling to the view as draw() does. The scene never animates, so every
+/// frame is the same work; the last is written. No axes or readout.
+int renderHeadless(int frames, int proj, const char *path)
+{
+   const int size = 600;
+   SoftwareRasterizer raster(size, size);
+   const float dim = control.dim;
+   // as updateProjection() sets them for a square window
+   if (proj == 0)
+      raster.projection = Mat4::orthographic(-dim, dim, -dim, dim, -dim, dim * 2);
+   else
+      raster.projection = Mat4::frustum(-.08, .08, -.08, .08, .1, 1000);
+
+   auto view = Mat4::translation({0, 0, -dim})
+             * Mat4::rotation(control.orbitPitch, {1, 0, 0})
+             * Mat4::rotation(control.orbitYaw, {0, 1, 0});
+   auto frustum = ViewFrustum::fromMatrix(raster.projection * view);
+   auto start = std::chrono::steady_clock::now();
+   for (int frame = 0; frame < frames; frame++)
+   {
+      raster.clear(background);
+      raster.loadMatrix(view);
+      sceneBVH->render(&raster, frustum);
+      raster.finish();
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   auto stats = sceneBVH->stats;
+   printf("Rendered %d frames of %d triangles at %dx%d in %.2f s (%.1f FPS), drew %d/%d leaves\n",
+          frames, raster.triangleCount(), size, size, elapsed.count(), frames / elapsed.count(),
+          stats.drawn, sceneBVH->leafCount());
+   if (!raster.writePPM(path))
+   {
+      fprintf(stderr, "Could not write %s\n", path);
+      return 1;
+   }
+   printf("Wrote %s\n", path);
+   return 0;
 }
 
 int main(int argc, char *argv[])
 {
+   // -herd N adds N more buffs to the scene
+   int headlessProj = 0;
+   for (int i = 1; i < argc - 1; i++)
+   {
+      if (strcmp(argv[i], "-herd") == 0)
+         herdSize = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-headless") == 0)
+         headlessFrames = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-proj") == 0)
+         headlessProj = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-ppm") == 0)
+         headlessImage = argv[i + 1];
+   }
+
+   // the BVH and rasterizer run without GL, so build the herd and go
+   if (headlessFrames > 0)
+   {
+      initScene();
+      return renderHeadless(headlessFrames, headlessProj, headlessImage);
+   }
+
    //  Initialize GLUT and process user parameters
    glutInit(&argc, argv);
 
@@ -322,12 +402,14 @@ int main(int argc, char *argv[])
    glFrontFace(GL_CCW);
 
    initScene();
+   glClearColor(background.x, background.y, background.z, 1);
 
    glutDisplayFunc(draw);
    glutReshapeFunc(reshape);
    glutKeyboardFunc(key);
    glutSpecialFunc(special);
-   glutVisibilityFunc(visible);
+   // nothing animates, so frames come only from input and resizes
+   appLoopInit(nullptr);
 
    glutMainLoop();
    return 0; /* ANSI C requires main to return int. */
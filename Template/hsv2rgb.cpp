@@ -137,4 +137,249 @@ void HSVtoRGB(float& fR, float& fG, float& fB, float& fH, float& fS, float& fV)
   fR += fM;
   fG += fM;
   fB += fM;
-}
\ No newline at end of file
+}
+
+// Lane operations for the batch conversions below, which are written once
+// against these and instantiated one float, 4 (SSE) or 8 (AVX) wide
+struct HSVLanes1 {
+  typedef float V;
+  typedef bool M;
+  static const int nWidth = 1;
+  static V Load(const float* p) { return *p; }
+  static void Store(float* p, V a) { *p = a; }
+  static V Set(float f) { return f; }
+  static V Add(V a, V b) { return a + b; }
+  static V Sub(V a, V b) { return a - b; }
+  static V Mul(V a, V b) { return a * b; }
+  static V Div(V a, V b) { return a / b; }
+  static V Min(V a, V b) { return a < b ? a : b; }
+  static V Max(V a, V b) { return a > b ? a : b; }
+  // toward zero, which is floor for the non-negative values it gets
+  static V Trunc(V a) { return (float)(int)a; }
+  static M Less(V a, V b) { return a < b; }
+  static M Equal(V a, V b) { return a == b; }
+  // a where m, else b
+  static V Select(M m, V a, V b) { return m ? a : b; }
+};
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HSV_X86
+#include <immintrin.h>
+
+struct HSVLanes4 {
+  typedef __m128 V;
+  typedef __m128 M;
+  static const int nWidth = 4;
+  static V Load(const float* p) { return _mm_loadu_ps(p); }
+  static void Store(float* p, V a) { _mm_storeu_ps(p, a); }
+  static V Set(float f) { return _mm_set1_ps(f); }
+  static V Add(V a, V b) { return _mm_add_ps(a, b); }
+  static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V Div(V a, V b) { return _mm_div_ps(a, b); }
+  static V Min(V a, V b) { return _mm_min_ps(a, b); }
+  static V Max(V a, V b) { return _mm_max_ps(a, b); }
+  static V Trunc(V a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+  static M Less(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static M Equal(V a, V b) { return _mm_cmpeq_ps(a, b); }
+  static V Select(M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+
+#define HSV_AVX __attribute__((target("avx")))
+struct HSVLanes8 {
+  // wrapped, since a bare __m256 may not be passed around outside AVX code
+  struct V { __m256 v; };
+  typedef V M;
+  static const int nWidth = 8;
+  HSV_AVX static V Load(const float* p) { return V{_mm256_loadu_ps(p)}; }
+  HSV_AVX static void Store(float* p, V a) { _mm256_storeu_ps(p, a.v); }
+  HSV_AVX static V Set(float f) { return V{_mm256_set1_ps(f)}; }
+  HSV_AVX static V Add(V a, V b) { return V{_mm256_add_ps(a.v, b.v)}; }
+  HSV_AVX static V Sub(V a, V b) { return V{_mm256_sub_ps(a.v, b.v)}; }
+  HSV_AVX static V Mul(V a, V b) { return V{_mm256_mul_ps(a.v, b.v)}; }
+  HSV_AVX static V Div(V a, V b) { return V{_mm256_div_ps(a.v, b.v)}; }
+  HSV_AVX static V Min(V a, V b) { return V{_mm256_min_ps(a.v, b.v)}; }
+  HSV_AVX static V Max(V a, V b) { return V{_mm256_max_ps(a.v, b.v)}; }
+  HSV_AVX static V Trunc(V a) { return V{_mm256_cvtepi32_ps(_mm256_cvttps_epi32(a.v))}; }
+  HSV_AVX static M Less(V a, V b) { return V{_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+  HSV_AVX static M Equal(V a, V b) { return V{_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)}; }
+  // masks rather than blendv, which GCC rewrites into per lane branches without AVX2
+  HSV_AVX static V Select(M m, V a, V b) { return V{_mm256_or_ps(_mm256_and_ps(m.v, a.v), _mm256_andnot_ps(m.v, b.v))}; }
+};
+#endif
+
+
+/*! \brief Branchless HSV to RGB for one channel
+  
+  The channel is v minus the chroma times a clamped triangle wave in
+  hue, offset by `n' sextants (5 for red, 3 for green, 1 for blue), so
+  there is no sextant to branch on.
+  
+*/
+template <class L>
+static inline void HSVChannel(const typename L::V& n, const typename L::V& h, const typename L::V& s, const typename L::V& v,
+                              typename L::V& out) {
+  typedef typename L::V V;
+  V k = L::Add(n, L::Mul(h, L::Set(1.0f / 60)));
+  // fmod(k, 6)
+  k = L::Sub(k, L::Mul(L::Set(6), L::Trunc(L::Mul(k, L::Set(1.0f / 6)))));
+  V w = L::Min(L::Min(k, L::Sub(L::Set(4), k)), L::Set(1));
+  w = L::Max(w, L::Set(0));
+  out = L::Sub(v, L::Mul(L::Mul(v, s), w));
+}
+
+// Colors [i, nCount) in whole vectors; returns where it stopped
+template <class L>
+static inline int HSVtoRGBLanes(float* fR, float* fG, float* fB, const float* fH, const float* fS, const float* fV, int i, int nCount) {
+  for(; i + L::nWidth <= nCount; i += L::nWidth) {
+    typename L::V h = L::Load(fH + i), s = L::Load(fS + i), v = L::Load(fV + i), out;
+    HSVChannel<L>(L::Set(5), h, s, v, out);
+    L::Store(fR + i, out);
+    HSVChannel<L>(L::Set(3), h, s, v, out);
+    L::Store(fG + i, out);
+    HSVChannel<L>(L::Set(1), h, s, v, out);
+    L::Store(fB + i, out);
+  }
+  return i;
+}
+
+template <class L>
+static inline int RGBtoHSVLanes(const float* fR, const float* fG, const float* fB, float* fH, float* fS, float* fV, int i, int nCount) {
+  typedef typename L::V V;
+  for(; i + L::nWidth <= nCount; i += L::nWidth) {
+    V r = L::Load(fR + i), g = L::Load(fG + i), b = L::Load(fB + i);
+    V cmax = L::Max(L::Max(r, g), b);
+    V cmin = L::Min(L::Min(r, g), b);
+    V delta = L::Sub(cmax, cmin);
+    
+    // all three hue formulas, then the one RGBtoHSV would have taken; a
+    // zero delta is swapped for 1 so the discarded ones stay finite
+    V zero = L::Set(0), one = L::Set(1);
+    V inverse = L::Div(one, L::Select(L::Less(zero, delta), delta, one));
+    V hue = L::Select(L::Equal(cmax, r), L::Mul(L::Sub(g, b), inverse),
+            L::Select(L::Equal(cmax, g), L::Add(L::Mul(L::Sub(b, r), inverse), L::Set(2)),
+                                         L::Add(L::Mul(L::Sub(r, g), inverse), L::Set(4))));
+    hue = L::Mul(hue, L::Set(60));
+    hue = L::Select(L::Less(hue, zero), L::Add(hue, L::Set(360)), hue);
+    
+    L::Store(fH + i, L::Select(L::Less(zero, delta), hue, zero));
+    L::Store(fS + i, L::Select(L::Less(zero, cmax), L::Div(delta, L::Select(L::Less(zero, cmax), cmax, one)), zero));
+    L::Store(fV + i, cmax);
+  }
+  return i;
+}
+
+#ifdef HSV_X86
+// flatten inlines the lane operations so AVX values never cross a call
+HSV_AVX __attribute__((flatten))
+int HSVtoRGBBatchAVX(float* fR, float* fG, float* fB, const float* fH, const float* fS, const float* fV, int nCount) {
+  return HSVtoRGBLanes<HSVLanes8>(fR, fG, fB, fH, fS, fV, 0, nCount);
+}
+
+HSV_AVX __attribute__((flatten))
+int RGBtoHSVBatchAVX(const float* fR, const float* fG, const float* fB, float* fH, float* fS, float* fV, int nCount) {
+  return RGBtoHSVLanes<HSVLanes8>(fR, fG, fB, fH, fS, fV, 0, nCount);
+}
+
+static inline bool HSVHasAVX() {
+  static const bool bAVX = __builtin_cpu_supports("avx");
+  return bAVX;
+}
+#endif
+
+
+/*! \brief Convert arrays of HSV colors to RGB
+  
+  Batch form of HSVtoRGB over `nCount' colors stored as separate
+  arrays. Branchless and vectorized: 8 at a time with AVX when the CPU
+  has it, else 4 with SSE, with the scalar form for the remainder and
+  for other platforms. Agrees with HSVtoRGB to within float rounding
+  for hue in [0, 360].
+  
+  \param fR Red components, output, range: [0, 1]
+  \param fG Green components, output, range: [0, 1]
+  \param fB Blue components, output, range: [0, 1]
+  \param fH Hue components, input, range: [0, 360]
+  \param fS Saturation components, input, range: [0, 1]
+  \param fV Value components, input, range: [0, 1]
+  \param nCount Number of colors
+  
+*/
+void HSVtoRGBBatch(float* fR, float* fG, float* fB, const float* fH, const float* fS, const float* fV, int nCount) {
+  int i = 0;
+#ifdef HSV_X86
+  if(HSVHasAVX()) {
+    i = HSVtoRGBBatchAVX(fR, fG, fB, fH, fS, fV, nCount);
+  } else {
+    i = HSVtoRGBLanes<HSVLanes4>(fR, fG, fB, fH, fS, fV, 0, nCount);
+  }
+#endif
+  HSVtoRGBLanes<HSVLanes1>(fR, fG, fB, fH, fS, fV, i, nCount);
+}
+
+
+/*! \brief Convert arrays of RGB colors to HSV
+  
+  Batch form of RGBtoHSV, selecting between the three hue formulas
+  instead of branching. Agrees with RGBtoHSV to within float rounding.
+  
+  \param fR Red components, input, range: [0, 1]
+  \param fG Green components, input, range: [0, 1]
+  \param fB Blue components, input, range: [0, 1]
+  \param fH Hue components, output, range: [0, 360]
+  \param fS Saturation components, output, range: [0, 1]
+  \param fV Value components, output, range: [0, 1]
+  \param nCount Number of colors
+  
+*/
+void RGBtoHSVBatch(const float* fR, const float* fG, const float* fB, float* fH, float* fS, float* fV, int nCount) {
+  int i = 0;
+#ifdef HSV_X86
+  if(HSVHasAVX()) {
+    i = RGBtoHSVBatchAVX(fR, fG, fB, fH, fS, fV, nCount);
+  } else {
+    i = RGBtoHSVLanes<HSVLanes4>(fR, fG, fB, fH, fS, fV, 0, nCount);
+  }
+#endif
+  RGBtoHSVLanes<HSVLanes1>(fR, fG, fB, fH, fS, fV, i, nCount);
+}
+
+
+// Weights HSVChannel gives red, green and blue at each hue bin
+struct HSVTable {
+  static const int nBins = 1536;
+  float fWeights[nBins + 1][3];
+  
+  HSVTable() {
+    for(int i = 0; i <= nBins; i++) {
+      float fHue = 360.0f * i / nBins;
+      float fOffsets[3] = {5, 3, 1};
+      for(int c = 0; c < 3; c++) {
+        HSVChannel<HSVLanes1>(fOffsets[c], fHue, 1, 1, fWeights[i][c]);
+        fWeights[i][c] = 1 - fWeights[i][c];
+      }
+    }
+  }
+};
+
+
+/*! \brief Convert arrays of HSV colors to RGB through a hue table
+  
+  Like HSVtoRGBBatch, but the hue dependent weights come from a table
+  of 1536 bins (256 per sextant) built on first use, with hue rounded
+  to the nearest bin. Off by at most 1/512 of the chroma.
+  
+  \param nCount Number of colors; the others as for HSVtoRGBBatch
+  
+*/
+void HSVtoRGBLookup(float* fR, float* fG, float* fB, const float* fH, const float* fS, const float* fV, int nCount) {
+  static const HSVTable table;
+  for(int i = 0; i < nCount; i++) {
+    int nBin = (int)(fH[i] * (HSVTable::nBins / 360.0f) + 0.5f);
+    nBin = nBin < 0 ? 0 : (nBin > HSVTable::nBins ? HSVTable::nBins : nBin);
+    float fC = fV[i] * fS[i];
+    fR[i] = fV[i] - fC * table.fWeights[nBin][0];
+    fG[i] = fV[i] - fC * table.fWeights[nBin][1];
+    fB[i] = fV[i] - fC * table.fWeights[nBin][2];
+  }
+}
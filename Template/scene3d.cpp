@@ -23,6 +23,7 @@
 #endif
 
 #include "hsv2rgb.cpp"
+#include "appLoop.h"
 
 struct orbit {
    float pitch = 0;
@@ -84,10 +85,6 @@ void draw()
    glFlush();
 }
 
-// -------- Idle Hook -------- //
-void idle() {
-}
-
 // -------- Window Reshape -------- //
 void reshape(int width, int height)
 {
@@ -141,15 +138,6 @@ void special(int key, int x, int y)
    glutPostRedisplay();
 }
 
-// -------- Visibility -------- //
-void visible(int vis)
-{
-   if (vis == GLUT_VISIBLE)
-      glutIdleFunc(idle);
-   else
-      glutIdleFunc(NULL);
-}
-
 int main(int argc, char *argv[])
 {
    //  Initialize GLUT and process user parameters
@@ -172,7 +160,8 @@ int main(int argc, char *argv[])
    glutReshapeFunc(reshape);
    glutKeyboardFunc(key);
    glutSpecialFunc(special);
-   glutVisibilityFunc(visible);
+   // nothing animates, so frames come only from input and resizes
+   appLoopInit(nullptr);
 
    glutMainLoop();
    return 0; /* ANSI C requires main to return int. */
@@ -0,0 +1,80 @@
+#pragma once
+// Include after GLUT
+
+/// @brief Event driven main loop. A frame is drawn only when something asks
+/// for one: input, a resize or expose, or a running animation. Animation steps
+/// on glutTimerFunc at a capped frame rate, and between frames GLUT sleeps in
+/// its event wait instead of spinning through an idle callback.
+struct AppLoop
+{
+   /// @brief Advances the scene to t seconds of animation, not counting time
+   /// paused or hidden. nullptr for a scene that only changes on input.
+   void (*animate)(double t) = nullptr;
+   int fps = 60;
+   bool animating = false;
+   bool visible = true;
+   // a timer is pending
+   bool ticking = false;
+   double time = 0;
+   // milliseconds, from glutGet(GLUT_ELAPSED_TIME)
+   int lastTick = 0;
+   int nextTick = 0;
+};
+
+static AppLoop appLoop;
+
+inline void appLoopTick(int)
+{
+   appLoop.ticking = false;
+   if (!appLoop.animating || !appLoop.visible)
+      return;
+
+   int now = glutGet(GLUT_ELAPSED_TIME);
+   appLoop.time += (now - appLoop.lastTick) / 1000.0;
+   appLoop.lastTick = now;
+   appLoop.animate(appLoop.time);
+   glutPostRedisplay();
+
+   // keep to the frame schedule, but never try to catch up on missed frames
+   appLoop.nextTick += 1000 / appLoop.fps;
+   if (appLoop.nextTick < now)
+      appLoop.nextTick = now;
+   glutTimerFunc(appLoop.nextTick - now, appLoopTick, 0);
+   appLoop.ticking = true;
+}
+
+/// @brief Turns continuous animation on or off. While off, or while the
+/// window is hidden, no timer runs and the scene is redrawn only on demand.
+inline void appLoopAnimate(bool on)
+{
+   bool resuming = on && !appLoop.animating;
+   appLoop.animating = on && appLoop.animate;
+   if (!appLoop.animating || !appLoop.visible)
+      return;
+
+   int now = glutGet(GLUT_ELAPSED_TIME);
+   // a timer still pending from before a pause picks up from here
+   if (resuming || !appLoop.ticking)
+      appLoop.lastTick = appLoop.nextTick = now;
+   if (!appLoop.ticking)
+      appLoopTick(0);
+}
+
+inline void appLoopVisible(int vis)
+{
+   bool shown = vis == GLUT_VISIBLE && !appLoop.visible;
+   appLoop.visible = vis == GLUT_VISIBLE;
+   if (shown)
+      appLoopAnimate(appLoop.animating);
+}
+
+/// @brief Hooks the loop into GLUT, in place of an idle callback. With an
+/// animate function the scene animates at up to fps frames per second from
+/// the start.
+inline void appLoopInit(void (*animate)(double t), int fps = 60)
+{
+   appLoop.animate = animate;
+   appLoop.fps = fps > 0 ? fps : 60;
+   glutVisibilityFunc(appLoopVisible);
+   appLoopAnimate(animate != nullptr);
+}
@@ -0,0 +1,79 @@
+#include <cstdlib>
+#include "arena.h"
+
+thread_local Arena *Arena::current = nullptr;
+
+Arena::Scope::Scope(Arena *arena)
+{
+    previous = Arena::current;
+    Arena::current = arena;
+}
+
+Arena::Scope::~Scope()
+{
+    Arena::current = previous;
+}
+
+Arena::Arena(size_t blockSize)
+{
+    this->blockSize = blockSize;
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    offset = (offset + alignment - 1) & ~(alignment - 1);
+
+    if (blocks.empty() || offset + size > blockSize)
+    {
+        // oversized requests get a block of their own
+        size_t capacity = size > blockSize ? size : blockSize;
+        auto block = (char *)malloc(capacity);
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (size > blockSize && !blocks.empty())
+        {
+            // keep bumping through the current block afterwards
+            blocks.insert(blocks.end() - 1, block);
+            used += size;
+            return block;
+        }
+
+        blocks.push_back(block);
+        offset = 0;
+    }
+
+    void *memory = blocks.back() + offset;
+    offset += size;
+    used += size;
+    return memory;
+}
+
+void Arena::release()
+{
+    for (auto it = destructors.rbegin(); it != destructors.rend(); it++)
+    {
+        it->destroy(it->object);
+    }
+    destructors.clear();
+
+    for (char *block : blocks)
+    {
+        free(block);
+    }
+    blocks.clear();
+    used = 0;
+    offset = 0;
+}
+
+size_t Arena::bytesUsed()
+{
+    return used;
+}
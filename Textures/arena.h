@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <initializer_list>
+
+struct Drawable;
+
+/// @brief Bump allocator for scene nodes. Nodes are carved out of large blocks
+/// so a scene sits together in memory, and release() tears the whole scene
+/// down at once instead of node by node.
+class Arena {
+    public:
+        /// @brief Arena used by make(), or nullptr for the plain heap.
+        /// Per thread, so scenes can be built in parallel.
+        static thread_local Arena *current;
+
+        /// @brief Makes an arena current until the scope ends.
+        struct Scope {
+            Arena *previous;
+            Scope(Arena *arena);
+            ~Scope();
+        };
+
+        Arena(size_t blockSize = 1 << 20);
+        ~Arena();
+
+        void *allocate(size_t size, size_t alignment);
+        /// @brief Run the destructors of everything made here, newest first,
+        /// then free the blocks.
+        void release();
+        size_t bytesUsed();
+
+        template <class T>
+        void track(T *object)
+        {
+            destructors.push_back({object, [](void *p) { static_cast<T *>(p)->~T(); }});
+        }
+
+    private:
+        struct Destructor {
+            void *object;
+            void (*destroy)(void *);
+        };
+
+        size_t blockSize;
+        size_t used = 0;
+        size_t offset = 0;
+        std::vector<char *> blocks;
+        std::vector<Destructor> destructors;
+};
+
+/// @brief Construct a scene node in the current arena, or with new when
+/// there is none. Arena nodes are marked so a Box never deletes them.
+template <class T, class... Args>
+T *make(Args &&...args)
+{
+    if (!Arena::current)
+    {
+        return new T(std::forward<Args>(args)...);
+    }
+
+    auto arena = Arena::current;
+    T *object = new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    object->arenaOwned = true;
+    arena->track(object);
+    return object;
+}
+
+/// @brief make() for containers built from a braced list of children
+template <class T>
+T *make(std::initializer_list<Drawable *> children)
+{
+    return make<T, std::initializer_list<Drawable *> &>(children);
+}
@@ -0,0 +1,340 @@
+#include "CSCIx229.h"
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <utility>
+#include <algorithm>
+
+#include "bench.h"
+#include "models/buff.h"
+#include "render.h"
+
+typedef std::chrono::steady_clock Clock;
+
+#ifdef COUNT_ALLOCATIONS
+//  Every heap allocation in the program passes through here, so this is
+//  only built into the bench target (make bench), never into hw6 itself
+static std::atomic<long> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+   heapAllocations++;
+   void *memory = malloc(size ? size : 1);
+   if (!memory)
+      throw std::bad_alloc();
+   return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+   free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+   free(memory);
+}
+#endif
+
+static double millisSince(Clock::time_point start)
+{
+   return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+ *  Build, draw and tear down a herd of buffs, once with plain new/delete
+ *  and once from an Arena
+ */
+void benchmarkArena(int buffs, int frames)
+{
+   printf("%-6s %12s %12s %14s %12s\n", "alloc", "build ms", "draw ms", "teardown ms", "arena KiB");
+
+   for (int useArena = 0; useArena < 2; useArena++)
+   {
+      Arena arena;
+      Box *herd;
+
+      auto start = Clock::now();
+      {
+         Arena::Scope scope(useArena ? &arena : nullptr);
+         std::vector<Drawable *> members;
+         for (int i = 0; i < buffs; i++)
+            members.push_back(buildBuff()->scale(.05)->move({(float)(i % 32) * .2f - 3, 0, (float)(i / 32) * .2f - 3}));
+         herd = make<Box>(members);
+      }
+      double build = millisSince(start);
+
+      start = Clock::now();
+      for (int i = 0; i < frames; i++)
+      {
+         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+         herd->draw();
+      }
+      glFinish();
+      double draw = millisSince(start) / frames;
+
+      size_t arenaBytes = arena.bytesUsed();
+      start = Clock::now();
+      if (useArena)
+         arena.release();
+      else
+         delete herd;
+      double teardown = millisSince(start);
+
+      printf("%-6s %12.2f %12.2f %14.2f %12lu\n", useArena ? "arena" : "heap", build, draw, teardown,
+             arenaBytes / 1024);
+   }
+}
+
+/*
+ *  Inverse transpose of the upper 3x3 of m by Gauss-Jordan elimination,
+ *  row-major, independent of the cofactors transformNormal uses
+ */
+static void inverseTranspose(Mat4 m, float out[3][3])
+{
+   double a[3][6];
+   for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+      {
+         a[r][c] = m.m[c * 4 + r];
+         a[r][c + 3] = r == c;
+      }
+   for (int c = 0; c < 3; c++)
+   {
+      int pivot = c;
+      for (int r = c + 1; r < 3; r++)
+         if (fabs(a[r][c]) > fabs(a[pivot][c]))
+            pivot = r;
+      for (int k = 0; k < 6; k++)
+         std::swap(a[c][k], a[pivot][k]);
+      double scale = a[c][c];
+      for (int k = 0; k < 6; k++)
+         a[c][k] /= scale;
+      for (int r = 0; r < 3; r++)
+      {
+         double f = a[r][c];
+         if (r != c)
+            for (int k = 0; k < 6; k++)
+               a[r][k] -= f * a[c][k];
+      }
+   }
+   for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+         out[r][c] = a[c][r + 3];
+}
+
+/*
+ *  Compare transformNormal with the inverse transpose every 5 degrees
+ *  round each axis, plain, scaled unevenly, and mirrored
+ */
+bool checkNormals()
+{
+   Vec3 axes[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1}};
+   Vec3 scales[] = {{1, 1, 1}, {2, .5, 3}, {-1, 1, 1}};
+   Vec3 normals[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {.6, 0, .8}};
+   float worst = 0;
+
+   for (Vec3 axis : axes)
+      for (Vec3 scale : scales)
+         for (int degrees = 0; degrees < 360; degrees += 5)
+         {
+            Mat4 m = Mat4::rotation(degrees, axis) * Mat4::scaling(scale);
+            float it[3][3];
+            inverseTranspose(m, it);
+            for (Vec3 n : normals)
+            {
+               Vec3 expected = Vec3{
+                  it[0][0] * n.x + it[0][1] * n.y + it[0][2] * n.z,
+                  it[1][0] * n.x + it[1][1] * n.y + it[1][2] * n.z,
+                  it[2][0] * n.x + it[2][1] * n.y + it[2][2] * n.z,
+               }.normalized();
+               worst = fmax(worst, (m.transformNormal(n) - expected).magnitude());
+            }
+         }
+
+   bool passed = worst < 1e-4;
+   printf("Normal transform: largest difference from the inverse transpose %g (%s)\n",
+          worst, passed ? "ok" : "WRONG");
+   return passed;
+}
+
+/*
+ *  Count heap allocations made while moving polygons around
+ */
+bool checkAllocations()
+{
+   auto prism = Polygon({{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}}).extrude({0, 1, 0});
+   auto bounds = prism->bounds();
+
+#ifdef COUNT_ALLOCATIONS
+   long before = heapAllocations;
+#endif
+   prism->translate({1, 2, 3});
+   bounds = prism->bounds();
+   for (Polygon &face : prism->getPolygons())
+      face -= {1, 2, 3};
+   auto moved = *prism->getPolygons().begin() + Vec3{0, 1, 0};
+#ifdef COUNT_ALLOCATIONS
+   long allocations = heapAllocations - before;
+   printf("Prism translate: %ld heap allocations (bounds y %.1f..%.1f, moved y %.1f)\n",
+          allocations, bounds.min.y, bounds.max.y, moved.verticies[0].y);
+#else
+   long allocations = 0;
+   printf("Prism translate: allocations not counted, build with make bench (bounds y %.1f..%.1f, moved y %.1f)\n",
+          bounds.min.y, bounds.max.y, moved.verticies[0].y);
+#endif
+
+   // a mesh built while the faces are open must not outlive the edit
+   bool fresh;
+   {
+      auto faces = prism->getPolygons();
+      prism->toMesh();
+      prism->bounds();
+      for (Polygon &face : faces)
+         face += {0, 5, 0};
+   }
+   fresh = prism->bounds().min.y == 5 && prism->toMesh().verticies[0].position.y >= 5;
+   if (!fresh)
+      printf("Prism faces: mesh or bounds stale after an edit through getPolygons()\n");
+   delete prism;
+   return allocations == 0 && fresh;
+}
+
+/*
+ *  A floor under a perspective camera that reaches behind the eye, so two
+ *  of its corners have w < 0 and must be clipped at the near plane
+ */
+bool checkClipping()
+{
+   const int size = 64;
+   SoftwareRasterizer raster(size, size, 1);
+   raster.projection = Mat4::perspective(60, 1, 1, 100);
+   raster.light.ambient = {1, 1, 1};
+   raster.light.diffuse = {0, 0, 0};
+   raster.light.specular = {0, 0, 0};
+
+   Polygon floor({{-10, -1, 10}, {10, -1, 10}, {10, -1, -50}, {-10, -1, -50}}, {1, 1, 1});
+   raster.clear({0, 0, 0});
+   raster.drawPolygon(floor);
+   raster.finish();
+
+   // the floor should cover the bottom row, right under the camera
+   int covered = 0;
+   for (int x = 0; x < size; x++)
+      covered += raster.pixels[x * 3] == 255;
+   printf("Near plane clipping: %d triangles, %d of %d bottom row pixels covered\n",
+          raster.triangleCount(), covered, size);
+   return covered == size;
+}
+
+/*
+ *  One command as it will be drawn: state, matrix and geometry, with
+ *  nothing that depends on the order transforms were recorded in
+ */
+struct DrawnCommand
+{
+   uint64_t state;
+   float matrix[16];
+   const void *geometry;
+
+   bool operator<(const DrawnCommand &other) const
+   {
+      if (state != other.state)
+         return state < other.state;
+      for (int i = 0; i < 16; i++)
+         if (matrix[i] != other.matrix[i])
+            return matrix[i] < other.matrix[i];
+      return geometry < other.geometry;
+   }
+   bool operator==(const DrawnCommand &other) const
+   {
+      return !(*this < other) && !(other < *this);
+   }
+};
+
+static std::vector<DrawnCommand> drawnCommands(CommandBuffer &buffer)
+{
+   std::vector<DrawnCommand> drawn;
+   for (auto &command : buffer.commands)
+   {
+      DrawnCommand d;
+      d.state = command.key >> CommandBuffer::stateShift;
+      memcpy(d.matrix, buffer.transforms[command.transform].m, sizeof(d.matrix));
+      d.geometry = command.polygon ? (const void *)command.polygon : (const void *)command.mesh;
+      drawn.push_back(d);
+   }
+   std::sort(drawn.begin(), drawn.end());
+   return drawn;
+}
+
+/*
+ *  Record a herd of buffs into a command buffer on one thread, then split
+ *  across worker threads and joined, and compare the sorted commands
+ */
+bool checkCommandBuffer(int buffs, int threads)
+{
+   std::vector<Drawable *> members;
+   for (int i = 0; i < buffs; i++)
+      members.push_back(buildBuff()->scale(.05)->move({(float)(i % 32) * .2f - 3, 0, (float)(i / 32) * .2f - 3}));
+   auto herd = new Box(members);
+
+   // record straight away, so the workers below race to build each prism's
+   // cached mesh, which toMesh() must survive
+   std::vector<CommandBuffer> parts(threads);
+   std::vector<std::thread> workers;
+   for (int t = 0; t < threads; t++)
+   {
+      workers.push_back(std::thread([&, t]() {
+         for (int i = 0; i < buffs; i++)
+            herd->children[(i + t * buffs / threads) % buffs]->render(&parts[t]);
+      }));
+   }
+   for (auto &worker : workers)
+      worker.join();
+   for (auto &part : parts)
+      part.clear();
+   workers.clear();
+
+   CommandBuffer single;
+
+   auto start = Clock::now();
+   herd->render(&single);
+   single.sort();
+   double singleTime = millisSince(start);
+
+   // the herd box has no transform of its own, so members can be recorded apart
+   CommandBuffer joined;
+   start = Clock::now();
+   for (int t = 0; t < threads; t++)
+   {
+      workers.push_back(std::thread([&, t]() {
+         for (int i = t; i < buffs; i += threads)
+            herd->children[i]->render(&parts[t]);
+      }));
+   }
+   for (auto &worker : workers)
+      worker.join();
+   for (auto &part : parts)
+      joined.append(part);
+   joined.sort();
+   double joinedTime = millisSince(start);
+
+   // transform indices differ between the two, but what is drawn must not
+   auto singleDrawn = drawnCommands(single);
+   bool same = singleDrawn == drawnCommands(joined) && single.stats.batches == joined.stats.batches;
+
+   // one batch per state, or the sort is not grouping by it
+   int states = 0;
+   for (unsigned int i = 0; i < singleDrawn.size(); i++)
+      if (i == 0 || singleDrawn[i].state != singleDrawn[i - 1].state)
+         states++;
+   bool grouped = single.stats.batches == states;
+   printf("Command buffer: %d draw calls become %d commands in %d batches\n",
+          herd->drawCalls(), single.stats.commands, single.stats.batches);
+   printf("Recorded and sorted in %.2f ms on 1 thread, %.2f ms on %d (%s, %s)\n",
+          singleTime, joinedTime, threads, same ? "same result" : "MISMATCH",
+          grouped ? "one batch per state" : "STATES SPLIT");
+   delete herd;
+   return same && grouped;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ *  Benchmarks, run with -bench once a GL context exists
+ */
+void benchmarkArena(int buffs, int frames);
+/// @brief Returns false if Mat4::transformNormal disagrees with the inverse
+/// transpose for rotations round the full circle, with and without scaling
+bool checkNormals();
+/// @brief Returns false if translating a Prism touches the heap (counted only
+/// when built with COUNT_ALLOCATIONS, see make bench) or if editing its faces
+/// leaves the mesh or bounds stale
+bool checkAllocations();
+/// @brief Returns false if the software rasterizer drops a floor that runs
+/// from in front of the camera to behind it, instead of clipping it
+bool checkClipping();
+/// @brief Records a herd into command buffers on one thread and on several,
+/// returns false if the sorted results differ
+bool checkCommandBuffer(int buffs, int threads);
@@ -1,4 +1,8 @@
 #include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
 #ifdef USEGLEW
 #include <GL/glew.h>
 #endif
@@ -10,9 +14,155 @@
 #endif
 
 #include "geometry.h"
+#include "render.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+// ------ Mat4 ------ //
+
+Mat4 Mat4::identity()
+{
+    return Mat4{{
+        1, 0, 0, 0, // x
+        0, 1, 0, 0, // y
+        0, 0, 1, 0, // z
+        0, 0, 0, 1, // w
+    }};
+}
+
+/// @brief Same matrix glTranslatef would multiply by
+Mat4 Mat4::translation(Vec3 offset)
+{
+    auto result = identity();
+    result.m[12] = offset.x;
+    result.m[13] = offset.y;
+    result.m[14] = offset.z;
+    return result;
+}
+
+/// @brief Same matrix glScalef would multiply by
+Mat4 Mat4::scaling(Vec3 scale)
+{
+    auto result = identity();
+    result.m[0] = scale.x;
+    result.m[5] = scale.y;
+    result.m[10] = scale.z;
+    return result;
+}
+
+/// @brief Same matrix glOrtho would multiply by
+Mat4 Mat4::orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    auto result = identity();
+    result.m[0] = 2 / (right - left);
+    result.m[5] = 2 / (top - bottom);
+    result.m[10] = -2 / (zFar - zNear);
+    result.m[12] = -(right + left) / (right - left);
+    result.m[13] = -(top + bottom) / (top - bottom);
+    result.m[14] = -(zFar + zNear) / (zFar - zNear);
+    return result;
+}
+
+Mat4 Mat4::perspective(float fovy, float aspect, float zNear, float zFar)
+{
+    float f = 1 / tan(fovy * M_PI / 360);
+    auto result = identity();
+    result.m[0] = f / aspect;
+    result.m[5] = f;
+    result.m[10] = (zFar + zNear) / (zNear - zFar);
+    result.m[11] = -1;
+    result.m[14] = 2 * zFar * zNear / (zNear - zFar);
+    result.m[15] = 0;
+    return result;
+}
+
+/// @brief Same matrix glRotatef would multiply by
+Mat4 Mat4::rotation(float degrees, Vec3 axis)
+{
+    auto n = axis.normalized();
+    float radians = degrees * M_PI / 180;
+    float c = cos(radians);
+    float s = sin(radians);
+    float t = 1 - c;
+
+    return Mat4{{
+        n.x * n.x * t + c, n.y * n.x * t + n.z * s, n.x * n.z * t - n.y * s, 0,
+        n.x * n.y * t - n.z * s, n.y * n.y * t + c, n.y * n.z * t + n.x * s, 0,
+        n.x * n.z * t + n.y * s, n.y * n.z * t - n.x * s, n.z * n.z * t + c, 0,
+        0, 0, 0, 1,
+    }};
+}
+
+Mat4 Mat4::operator*(Mat4 other)
+{
+    Mat4 result;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            float sum = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                sum += m[k * 4 + row] * other.m[col * 4 + k];
+            }
+            result.m[col * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+Vec3 Mat4::transformPoint(Vec3 p)
+{
+    return {
+        m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+        m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+        m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14],
+    };
+}
+
+/// @brief Transform ignoring translation
+Vec3 Mat4::transformDirection(Vec3 d)
+{
+    return {
+        m[0] * d.x + m[4] * d.y + m[8] * d.z,
+        m[1] * d.x + m[5] * d.y + m[9] * d.z,
+        m[2] * d.x + m[6] * d.y + m[10] * d.z,
+    };
+}
+
+/// @brief Cofactor matrix of the upper 3x3, proportional to the inverse
+/// transpose, so normals stay perpendicular under non-uniform scale
+Vec3 Mat4::transformNormal(Vec3 n)
+{
+    float c[9] = {
+        m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+        m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+        m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4],
+    };
+    // cofactors are stored column-major too, so row 0's are c[0], c[3], c[6]
+    float det = m[0] * c[0] + m[4] * c[3] + m[8] * c[6];
+    float sign = det < 0 ? -1 : 1;
+
+    Vec3 result = {
+        c[0] * n.x + c[3] * n.y + c[6] * n.z,
+        c[1] * n.x + c[4] * n.y + c[7] * n.z,
+        c[2] * n.x + c[5] * n.y + c[8] * n.z,
+    };
+    return result.normalized() * sign;
+}
 
 // ------ BoundingBox ------ //
 
+BoundingBox BoundingBox::empty()
+{
+    return BoundingBox{
+        {INFINITY, INFINITY, INFINITY},
+        {-INFINITY, -INFINITY, -INFINITY},
+    };
+}
+
 Vec3 BoundingBox::center()
 {
     return (min + max) / 2;
@@ -23,6 +173,79 @@ Vec3 BoundingBox::size()
     return max - min;
 }
 
+bool BoundingBox::isEmpty()
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+BoundingBox BoundingBox::merged(BoundingBox other)
+{
+    return BoundingBox{
+        {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)},
+        {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)},
+    };
+}
+
+/// @brief Axis aligned box enclosing this box after a transform
+BoundingBox BoundingBox::transformed(Mat4 matrix)
+{
+    if (isEmpty())
+    {
+        return *this;
+    }
+
+    // transform the center, then project the half extents onto each axis
+    auto halfSize = size() / 2;
+    auto c = matrix.transformPoint(center());
+    auto m = matrix.m;
+    Vec3 extent = {
+        fabsf(m[0]) * halfSize.x + fabsf(m[4]) * halfSize.y + fabsf(m[8]) * halfSize.z,
+        fabsf(m[1]) * halfSize.x + fabsf(m[5]) * halfSize.y + fabsf(m[9]) * halfSize.z,
+        fabsf(m[2]) * halfSize.x + fabsf(m[6]) * halfSize.y + fabsf(m[10]) * halfSize.z,
+    };
+
+    return BoundingBox{c - extent, c + extent};
+}
+
+// ------ Drawable ------ //
+
+BoundingBox Drawable::bounds()
+{
+    if (boundsDirty)
+    {
+        cachedBounds = computeBounds();
+        boundsDirty = false;
+    }
+    return cachedBounds;
+}
+
+BoundingBox Drawable::worldBounds()
+{
+    if (worldBoundsDirty)
+    {
+        cachedWorldBounds = parent ? bounds().transformed(parent->worldMatrix()) : bounds();
+        worldBoundsDirty = false;
+    }
+    return cachedWorldBounds;
+}
+
+void Drawable::invalidateBounds()
+{
+    // a dirty node always has dirty ancestors, so stop at the first one
+    boundsDirty = true;
+    worldBoundsDirty = true;
+    for (Drawable *node = parent; node && !node->boundsDirty; node = node->parent)
+    {
+        node->boundsDirty = true;
+        node->worldBoundsDirty = true;
+    }
+}
+
+void Drawable::invalidateWorld()
+{
+    worldBoundsDirty = true;
+}
+
 // ---- Vec3 ---- //
 
 Vec3 Vec3::operator+(Vec3 other)
@@ -92,47 +315,157 @@ float* Vec3::toArray()
     return new float[4] {x, y, z, 1};
 };
 
+// ---- VertexList ---- //
+
+VertexList::VertexList() {}
+
+VertexList::VertexList(std::initializer_list<Vec3> vertices)
+{
+    reserve(vertices.size());
+    for (Vec3 vertex : vertices)
+    {
+        items[count++] = vertex;
+    }
+}
+
+VertexList::VertexList(const std::vector<Vec3> &vertices)
+{
+    reserve(vertices.size());
+    for (Vec3 vertex : vertices)
+    {
+        items[count++] = vertex;
+    }
+}
+
+VertexList::VertexList(const VertexList &other)
+{
+    *this = other;
+}
+
+VertexList::VertexList(VertexList &&other)
+{
+    *this = std::move(other);
+}
+
+VertexList &VertexList::operator=(const VertexList &other)
+{
+    if (this != &other)
+    {
+        count = 0;
+        reserve(other.count);
+        std::copy(other.items, other.items + other.count, items);
+        count = other.count;
+    }
+    return *this;
+}
+
+VertexList &VertexList::operator=(VertexList &&other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (other.items == other.local)
+    {
+        // inline storage can't be stolen, but copying it is cheap
+        count = 0;
+        reserve(other.count);
+        std::copy(other.items, other.items + other.count, items);
+        count = other.count;
+    }
+    else
+    {
+        if (items != local)
+        {
+            delete[] items;
+        }
+        items = other.items;
+        count = other.count;
+        capacity = other.capacity;
+        other.items = other.local;
+        other.capacity = inlineCapacity;
+    }
+
+    other.count = 0;
+    return *this;
+}
+
+VertexList::~VertexList()
+{
+    if (items != local)
+    {
+        delete[] items;
+    }
+}
+
+void VertexList::reserve(unsigned int capacity)
+{
+    if (capacity <= this->capacity)
+    {
+        return;
+    }
+
+    auto grown = new Vec3[capacity];
+    std::copy(items, items + count, grown);
+    if (items != local)
+    {
+        delete[] items;
+    }
+    items = grown;
+    this->capacity = capacity;
+}
+
+void VertexList::push_back(Vec3 vertex)
+{
+    if (count == capacity)
+    {
+        reserve(capacity * 2);
+    }
+    items[count++] = vertex;
+}
+
+void VertexList::reverse()
+{
+    std::reverse(items, items + count);
+}
+
 // ---- Polygon ---- //
 
-Polygon::Polygon(std::vector<Vec3> vertices, Vec3 color)
+Polygon::Polygon(VertexList &&vertices, Vec3 color)
 {
     if (vertices.size() < 3)
     {
         throw "Polygon must have at least 3 verticies";
     }
 
-    verticies.push_back(vertices[0]);
-    this->verticies = vertices;
+    this->verticies = std::move(vertices);
     this->color = color;
-    
-    // calculate the normal
-    
-    auto v1 = vertices[1] - vertices[0];
-    auto v2 = vertices[2] - vertices[0];
+    computeNormal();
+}
+
+Polygon::Polygon(std::initializer_list<Vec3> vertices, Vec3 color) : Polygon(VertexList(vertices), color) {}
+
+Polygon::Polygon(const std::vector<Vec3> &vertices, Vec3 color) : Polygon(VertexList(vertices), color) {}
+
+void Polygon::computeNormal()
+{
+    auto v1 = verticies[1] - verticies[0];
+    auto v2 = verticies[2] - verticies[0];
     auto normal = v1.cross(v2);
     this->normal = normal.normalized();
 }
 
-Polygon::Polygon(std::vector<Vec3> vertices) : Polygon(vertices, {1, 1, 1}) {}
-
 Polygon Polygon::operator+(Vec3 other)
 {
-    auto verticiesNext = std::vector<Vec3>();
-    for (Vec3 vertex : verticies)
-    {
-        verticiesNext.push_back(vertex + other);
-    }
-    return Polygon(verticiesNext, color);
+    auto next = *this;
+    return next += other;
 }
 
 Polygon Polygon::operator+(float scalar)
 {
-    auto verticiesNext = std::vector<Vec3>();
-    for (Vec3 vertex : verticies)
-    {
-        verticiesNext.push_back(vertex + scalar);
-    }
-    return Polygon(verticiesNext, color);
+    auto next = *this;
+    return next += scalar;
 }
 
 Polygon Polygon::operator-(Vec3 other)
@@ -145,22 +478,56 @@ Polygon Polygon::operator-(float scalar)
     return *this + ((scalar) * -1);
 }
 
-Polygon Polygon::reversed()
+Polygon &Polygon::operator+=(Vec3 other)
+{
+    for (Vec3 &vertex : verticies)
+    {
+        vertex = vertex + other;
+    }
+    invalidateBounds();
+    return *this;
+}
+
+Polygon &Polygon::operator+=(float scalar)
 {
-    auto verticiesNext = std::vector<Vec3>();
-    for (int i = verticies.size() - 1; i >= 0; i--)
+    for (Vec3 &vertex : verticies)
     {
-        verticiesNext.push_back(verticies[i]);
+        vertex = vertex + scalar;
     }
-    return Polygon(verticiesNext, color);
+    invalidateBounds();
+    return *this;
+}
+
+Polygon &Polygon::operator-=(Vec3 other)
+{
+    return *this += other * -1;
+}
+
+Polygon &Polygon::operator-=(float scalar)
+{
+    return *this += -scalar;
+}
+
+Polygon Polygon::reversed()
+{
+    auto next = *this;
+    return next.reverse();
+}
+
+/// @brief Flip the winding order, and so the facing, in place
+Polygon &Polygon::reverse()
+{
+    verticies.reverse();
+    normal = normal * -1;
+    return *this;
 }
 
 Prism* Polygon::extrude(Vec3 extrusion)
 {
-    return new Prism(*this, extrusion);
+    return make<Prism>(*this, extrusion);
 }
 
-BoundingBox Polygon::bounds()
+BoundingBox Polygon::computeBounds()
 {
     auto min = Vec3{INFINITY, INFINITY, INFINITY};
     auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
@@ -193,6 +560,36 @@ void Polygon::draw()
     glEnd();
 }
 
+void Polygon::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    auto transformed = VertexList();
+    transformed.reserve(verticies.size());
+    for (Vec3 vertex : verticies)
+    {
+        transformed.push_back(matrix.transformPoint(vertex));
+    }
+
+    // recompute rather than transform the normal so non-uniform scales stay correct
+    auto v1 = transformed[1] - transformed[0];
+    auto v2 = transformed[2] - transformed[0];
+    mesh->addPolygon(transformed, v1.cross(v2).normalized(), color);
+}
+
+int Polygon::drawCalls()
+{
+    return 1;
+}
+
+void Polygon::render(RenderBackend *backend)
+{
+    backend->drawPolygon(*this);
+}
+
+Vec3 Polygon::getNormal()
+{
+    return normal;
+}
+
 // ---- Frustum ---- //
 
 Frustum::Frustum(Polygon base1, Polygon base2, Vec3 color)
@@ -202,28 +599,28 @@ Frustum::Frustum(Polygon base1, Polygon base2, Vec3 color)
         throw "Base polygons must have the same number of verticies";
     }
     
+    int n = base1.verticies.size();
+    polygons.reserve(n + 2);
+
     base1.color = color;
     polygons.push_back(base1);
 
-    int n = base1.verticies.size();
     for (int i = 0; i < n; i++)
     {
-        auto verticies = std::vector<Vec3>();
-
         int i2 = (i + 1) % n;
         int j = n - i - 1;
         int j2 = j == 0 ? n - 1 : j - 1;
 
-        verticies.push_back(base1.verticies[i]);
-        verticies.push_back(base2.verticies[j]);
-        verticies.push_back(base2.verticies[j2]);
-        verticies.push_back(base1.verticies[i2]);
-
-        Polygon face = Polygon(verticies, color);
-        polygons.push_back(face);
+        polygons.push_back(Polygon({
+                                       base1.verticies[i],
+                                       base2.verticies[j],
+                                       base2.verticies[j2],
+                                       base1.verticies[i2],
+                                   },
+                                   color));
     }
 
-    polygons.push_back(base2);
+    polygons.push_back(std::move(base2));
 }
 
 Frustum::Frustum(Polygon base1, Polygon base2) : Frustum(base1, base2, base1.color) {}
@@ -241,6 +638,7 @@ Frustum* Frustum::painted(std::vector<Vec3> colors)
         polygons[i].color = color;
     }
 
+    meshDirty = true;
     return this;
 }
 
@@ -255,28 +653,60 @@ Frustum* Frustum::varigatePaint(float strength)
         polygons[i].color = (color - strength) + brightness;
     }
 
+    meshDirty = true;
     return this;
 }
 
 void Frustum::draw()
 {
-    for (int i = 0; i < polygons.size(); i++)
+    toMesh().drawArrays();
+}
+
+void Frustum::facesChanged()
+{
+    meshDirty = true;
+    invalidateBounds();
+}
+
+Frustum::Faces::Faces(Frustum *owner) : Span<Polygon>{owner->polygons.data(), owner->polygons.size()}, owner(owner)
+{
+    owner->facesChanged();
+}
+
+Frustum::Faces::Faces(Faces &&other) : Span<Polygon>(other), owner(other.owner)
+{
+    other.owner = nullptr;
+}
+
+Frustum::Faces::~Faces()
+{
+    if (owner)
     {
-        polygons[i].draw();
+        owner->facesChanged();
     }
 }
 
-std::vector<Polygon> Frustum::getPolygons()
+Frustum::Faces Frustum::getPolygons()
+{
+    return Faces(this);
+}
+
+Frustum* Frustum::translate(Vec3 offset)
 {
-    return polygons;
+    for (Polygon &polygon : polygons)
+    {
+        polygon += offset;
+    }
+    facesChanged();
+    return this;
 }
 
-BoundingBox Frustum::bounds()
+BoundingBox Frustum::computeBounds()
 {
     auto min = Vec3{INFINITY, INFINITY, INFINITY};
     auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
 
-    for (Polygon polygon : polygons)
+    for (Polygon &polygon : polygons)
     {
         auto polyBounds = polygon.bounds();
         auto polyMin = polyBounds.min;
@@ -294,9 +724,47 @@ BoundingBox Frustum::bounds()
     return BoundingBox{min, max};
 }
 
+void Frustum::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    mesh->append(toMesh(), matrix);
+}
+
+int Frustum::drawCalls()
+{
+    return 1;
+}
+
+void Frustum::render(RenderBackend *backend)
+{
+    backend->drawMesh(toMesh());
+}
+
+// Rebuilds are rare, so frustums share a few locks rather than carry one each
+static std::mutex meshLocks[16];
+
+Mesh &Frustum::toMesh()
+{
+    if (meshDirty.load(std::memory_order_acquire))
+    {
+        // the first thread in rebuilds, any others wait and reuse its mesh
+        std::lock_guard<std::mutex> lock(meshLocks[(uintptr_t)this / sizeof(Frustum) % 16]);
+        if (meshDirty.load(std::memory_order_relaxed))
+        {
+            mesh = Mesh();
+            for (Polygon &polygon : polygons)
+            {
+                polygon.bakeInto(&mesh, Mat4::identity());
+            }
+            mesh.weld();
+            meshDirty.store(false, std::memory_order_release);
+        }
+    }
+    return mesh;
+}
+
 Box* Frustum::boxed()
 {
-    return new Box({this});
+    return make<Box>({this});
 }
 
 // --------- Prism --------- //
@@ -309,73 +777,116 @@ Prism::Prism(Polygon base1, Vec3 extrusion, Vec3 color) : Frustum(base1, base1.r
 // container
 Box::Box(std::vector<Drawable *> children)
 {
-    this->children = children;
     this->identity();
+    for (Drawable *child : children)
+    {
+        this->add(child);
+    }
 }
 
 Box::Box(std::initializer_list<Drawable *> children)
 {
-    this->children = std::vector<Drawable *>();
+    this->identity();
     for (Drawable *child : children)
     {
-        this->children.push_back(child);
+        this->add(child);
     }
-    this->identity();
 }
 
 Box::~Box()
 {
     for (Drawable *child : children)
     {
-        delete child;
+        // arena children are destroyed by their arena
+        if (!child->arenaOwned)
+        {
+            delete child;
+        }
     }
 }
 
-void Box::identity()
+void Box::add(Drawable *child)
 {
-    float matrix[16] = {
-        1, 0, 0, 0, // x
-        0, 1, 0, 0, // y
-        0, 0, 1, 0, // z
-        0, 0, 0, 1, // w
-    };
+    children.push_back(child);
+    child->parent = this;
+    child->invalidateWorld();
+    this->invalidateBounds();
+}
 
-    for (int i = 0; i < 16; i++)
+/// @brief Detach a child without deleting it
+void Box::remove(Drawable *child)
+{
+    for (unsigned int i = 0; i < children.size(); i++)
     {
-        this->matrix[i] = matrix[i];
+        if (children[i] == child)
+        {
+            children.erase(children.begin() + i);
+            child->parent = nullptr;
+            child->invalidateWorld();
+            this->invalidateBounds();
+            return;
+        }
     }
+}
 
+void Box::identity()
+{
+    this->matrix = Mat4::identity();
     this->scaleFactor = {1, 1, 1};
+    this->matrixChanged();
 }
 
-BoundingBox Box::bounds()
+/// @brief The local matrix changed: bounds above and world caches below are stale
+void Box::matrixChanged()
 {
-    auto min = Vec3{INFINITY, INFINITY, INFINITY};
-    auto max = Vec3{-INFINITY, -INFINITY, -INFINITY};
+    this->invalidateBounds();
+    this->invalidateWorld();
+}
 
-    for (Drawable *child : children)
+Mat4 Box::worldMatrix()
+{
+    if (worldMatrixDirty)
     {
-        auto bounds = child->bounds();
-        auto childMin = bounds.min;
-        auto childMax = bounds.max;
+        cachedWorldMatrix = parent ? parent->worldMatrix() * matrix : matrix;
+        worldMatrixDirty = false;
+    }
+    return cachedWorldMatrix;
+}
 
-        min.x = std::min(min.x, childMin.x);
-        min.y = std::min(min.y, childMin.y);
-        min.z = std::min(min.z, childMin.z);
+void Box::invalidateWorld()
+{
+    Drawable::invalidateWorld();
 
-        max.x = std::max(max.x, childMax.x);
-        max.y = std::max(max.y, childMax.y);
-        max.z = std::max(max.z, childMax.z);
+    // a dirty world matrix implies a dirty subtree, so stop early
+    if (worldMatrixDirty)
+    {
+        return;
     }
 
-    return BoundingBox{min, max};
+    worldMatrixDirty = true;
+    for (Drawable *child : children)
+    {
+        child->invalidateWorld();
+    }
 }
 
-void Box::draw()
+/// @brief Children's bounds, moved into the parent's space by this box's matrix
+BoundingBox Box::computeBounds()
+{
+    auto bounds = BoundingBox::empty();
+    for (Drawable *child : children)
+    {
+        bounds = bounds.merged(child->bounds());
+    }
+
+    return bounds.transformed(matrix);
+}
+
+void Box::draw()
 {
     glPushMatrix();
 
-    glMultMatrixf(this->matrix);
+    glMultMatrixf(this->matrix.m);
     
     // center the box
     // auto size = this->bounds().size();
@@ -389,14 +900,66 @@ void Box::draw()
     glPopMatrix();
 }
 
+void Box::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    auto composed = matrix * this->matrix;
+    float previousTint = mesh->tint;
+    if (tintable)
+    {
+        mesh->tint = 1;
+    }
+
+    for (Drawable *child : children)
+    {
+        child->bakeInto(mesh, composed);
+    }
+
+    mesh->tint = previousTint;
+}
+
+Box* Box::tinted()
+{
+    this->tintable = true;
+    return this;
+}
+
+int Box::drawCalls()
+{
+    int calls = 0;
+    for (Drawable *child : children)
+    {
+        calls += child->drawCalls();
+    }
+    return calls;
+}
+
+void Box::render(RenderBackend *backend)
+{
+    backend->pushMatrix();
+    backend->multMatrix(matrix);
+    for (Drawable *child : children)
+    {
+        child->render(backend);
+    }
+    backend->popMatrix();
+}
+
+/// @brief Flatten this hierarchy into a single static mesh.
+/// The box is left untouched and may be deleted afterwards.
+BakedMesh* Box::baked()
+{
+    auto mesh = new BakedMesh();
+    this->bakeInto(mesh, Mat4::identity());
+    mesh->weld();
+    mesh->savedDrawCalls = this->drawCalls() - mesh->drawCalls();
+    return mesh;
+}
+
 Box* Box::scale(Vec3 scale)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glScalef(scale.x, scale.y, scale.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::scaling(scale);
     this->scaleFactor = this->scaleFactor.multComps(scale);
+    this->matrixChanged();
     return this;
 }
 
@@ -407,22 +970,630 @@ Box* Box::scale(float scale) {
 Box* Box::move(Vec3 pos)
 {
     pos = pos.multComps(this->scaleFactor.reciprocal());
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glTranslatef(pos.x, pos.y, pos.z);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix * Mat4::translation(pos);
+    this->matrixChanged();
     return this;
 }
 
 Box* Box::rotate(Vec3 rot)
 {
-    glPushMatrix();
-    glLoadMatrixf(this->matrix);
-    glRotatef(rot.x, 1, 0, 0);
-    glRotatef(rot.y, 0, 1, 0);
-    glRotatef(rot.z, 0, 0, 1);
-    glGetFloatv(GL_MODELVIEW_MATRIX, this->matrix);
-    glPopMatrix();
+    this->matrix = this->matrix
+                 * Mat4::rotation(rot.x, {1, 0, 0})
+                 * Mat4::rotation(rot.y, {0, 1, 0})
+                 * Mat4::rotation(rot.z, {0, 0, 1});
+    this->matrixChanged();
     return this;
+}
+
+// -------- Mesh -------- //
+
+void Mesh::addPolygon(VertexList &polygon, Vec3 normal, Vec3 color)
+{
+    unsigned int base = verticies.size();
+    for (Vec3 vertex : polygon)
+    {
+        verticies.push_back({vertex, normal, color, tint});
+    }
+
+    for (unsigned int i = 1; i + 1 < polygon.size(); i++)
+    {
+        indices.push_back(base);
+        indices.push_back(base + i);
+        indices.push_back(base + i + 1);
+    }
+}
+
+void Mesh::append(Mesh &other, Mat4 matrix)
+{
+    unsigned int base = verticies.size();
+    verticies.reserve(base + other.verticies.size());
+    for (MeshVertex &vertex : other.verticies)
+    {
+        verticies.push_back({
+            matrix.transformPoint(vertex.position),
+            matrix.transformNormal(vertex.normal),
+            vertex.color,
+            std::max(vertex.tint, tint),
+        });
+    }
+
+    indices.reserve(indices.size() + other.indices.size());
+    for (unsigned int index : other.indices)
+    {
+        indices.push_back(base + index);
+    }
+}
+
+void Mesh::append(Mesh &other)
+{
+    unsigned int base = verticies.size();
+    verticies.insert(verticies.end(), other.verticies.begin(), other.verticies.end());
+
+    indices.reserve(indices.size() + other.indices.size());
+    for (unsigned int index : other.indices)
+    {
+        indices.push_back(base + index);
+    }
+}
+
+namespace {
+    struct WeldKey {
+        long values[10];
+        bool operator==(const WeldKey &other) const
+        {
+            return std::equal(values, values + 10, other.values);
+        }
+    };
+
+    struct WeldKeyHash {
+        size_t operator()(const WeldKey &key) const
+        {
+            size_t hash = 14695981039346656037ull;
+            for (long value : key.values)
+            {
+                hash = (hash ^ (size_t)value) * 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+}
+
+void Mesh::weld(float epsilon)
+{
+    std::unordered_map<WeldKey, unsigned int, WeldKeyHash> seen;
+    std::vector<MeshVertex> welded;
+    std::vector<unsigned int> remap(verticies.size());
+
+    for (unsigned int i = 0; i < verticies.size(); i++)
+    {
+        auto &v = verticies[i];
+        float fields[10] = {
+            v.position.x, v.position.y, v.position.z,
+            v.normal.x, v.normal.y, v.normal.z,
+            v.color.x, v.color.y, v.color.z,
+            v.tint,
+        };
+
+        WeldKey key;
+        for (int f = 0; f < 10; f++)
+        {
+            key.values[f] = lroundf(fields[f] / epsilon);
+        }
+
+        auto found = seen.find(key);
+        if (found == seen.end())
+        {
+            found = seen.insert({key, (unsigned int)welded.size()}).first;
+            welded.push_back(v);
+        }
+        remap[i] = found->second;
+    }
+
+    for (unsigned int &index : indices)
+    {
+        index = remap[index];
+    }
+    verticies.swap(welded);
+}
+
+BoundingBox Mesh::positionBounds()
+{
+    auto bounds = BoundingBox::empty();
+    for (MeshVertex &vertex : verticies)
+    {
+        bounds = bounds.merged({vertex.position, vertex.position});
+    }
+    return bounds;
+}
+
+void Mesh::drawArrays()
+{
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), &verticies[0].position);
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), &verticies[0].normal);
+    glColorPointer(3, GL_FLOAT, sizeof(MeshVertex), &verticies[0].color);
+
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, indices.data());
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+}
+
+// -------- BakedMesh -------- //
+
+BakedMesh::BakedMesh() {}
+
+BakedMesh::~BakedMesh()
+{
+    if (vertexBuffer)
+    {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+}
+
+void BakedMesh::upload()
+{
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, verticies.size() * sizeof(MeshVertex), verticies.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+}
+
+void BakedMesh::bind(int tintAttribute)
+{
+    if (!vertexBuffer)
+    {
+        upload();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, normal));
+    glColorPointer(3, GL_FLOAT, sizeof(MeshVertex), (void *)offsetof(MeshVertex, color));
+
+    if (tintAttribute >= 0)
+    {
+        glEnableVertexAttribArray(tintAttribute);
+        glVertexAttribPointer(tintAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, tint));
+    }
+}
+
+void BakedMesh::unbind(int tintAttribute)
+{
+    if (tintAttribute >= 0)
+    {
+        glDisableVertexAttribArray(tintAttribute);
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void BakedMesh::draw()
+{
+    bind();
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    unbind();
+}
+
+BoundingBox BakedMesh::computeBounds()
+{
+    return positionBounds();
+}
+
+void BakedMesh::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    mesh->append(*this, matrix);
+}
+
+int BakedMesh::drawCalls()
+{
+    return 1;
+}
+
+void BakedMesh::render(RenderBackend *backend)
+{
+    backend->drawMesh(*this);
+}
+
+// -------- ViewFrustum -------- //
+
+ViewFrustum ViewFrustum::fromMatrix(Mat4 clip)
+{
+    // Gribb/Hartmann: each plane is the w row plus or minus another row
+    auto m = clip.m;
+    ViewFrustum frustum;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            float sign = side == 0 ? 1 : -1;
+            float *plane = frustum.planes[i * 2 + side];
+            for (int col = 0; col < 4; col++)
+            {
+                plane[col] = m[col * 4 + 3] + sign * m[col * 4 + i];
+            }
+        }
+    }
+    return frustum;
+}
+
+ViewFrustum ViewFrustum::current()
+{
+    Mat4 projection, modelview;
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+    return fromMatrix(projection * modelview);
+}
+
+int ViewFrustum::classify(BoundingBox box)
+{
+    int result = 2;
+    for (auto &plane : planes)
+    {
+        // the corner furthest along the plane normal, and the one nearest
+        Vec3 far = {
+            plane[0] >= 0 ? box.max.x : box.min.x,
+            plane[1] >= 0 ? box.max.y : box.min.y,
+            plane[2] >= 0 ? box.max.z : box.min.z,
+        };
+        Vec3 near = {
+            plane[0] >= 0 ? box.min.x : box.max.x,
+            plane[1] >= 0 ? box.min.y : box.max.y,
+            plane[2] >= 0 ? box.min.z : box.max.z,
+        };
+
+        if (plane[0] * far.x + plane[1] * far.y + plane[2] * far.z + plane[3] < 0)
+        {
+            return 0;
+        }
+        if (plane[0] * near.x + plane[1] * near.y + plane[2] * near.z + plane[3] < 0)
+        {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// -------- BVH -------- //
+
+// leaves per BVH node before it is split
+#define BVH_LEAF_SIZE 4
+
+BVH::BVH(Box *root)
+{
+    this->root = root;
+    rebuild();
+}
+
+void BVH::rebuild()
+{
+    leaves.clear();
+    nodes.clear();
+    collect(root);
+    if (!leaves.empty())
+    {
+        build(0, leaves.size());
+    }
+    invalidateBounds();
+}
+
+int BVH::leafCount()
+{
+    return leaves.size();
+}
+
+void BVH::collect(Drawable *drawable)
+{
+    auto box = dynamic_cast<Box *>(drawable);
+    if (box)
+    {
+        for (Drawable *child : box->children)
+        {
+            collect(child);
+        }
+        return;
+    }
+
+    auto matrix = drawable->parent ? drawable->parent->worldMatrix() : Mat4::identity();
+    leaves.push_back({drawable, matrix, drawable->worldBounds()});
+}
+
+/// @brief Median split along the longest axis of the leaf centers
+int BVH::build(int first, int count)
+{
+    int index = nodes.size();
+    nodes.push_back(Node{BoundingBox::empty(), -1, -1, first, count});
+
+    auto bounds = BoundingBox::empty();
+    auto centers = BoundingBox::empty();
+    for (int i = first; i < first + count; i++)
+    {
+        bounds = bounds.merged(leaves[i].bounds);
+        auto center = leaves[i].bounds.center();
+        centers = centers.merged({center, center});
+    }
+    nodes[index].bounds = bounds;
+
+    if (count <= BVH_LEAF_SIZE)
+    {
+        return index;
+    }
+
+    auto size = centers.size();
+    int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    auto axisOf = [axis](Leaf &leaf) {
+        auto center = leaf.bounds.center();
+        return axis == 0 ? center.x : axis == 1 ? center.y : center.z;
+    };
+
+    int half = count / 2;
+    std::nth_element(leaves.begin() + first, leaves.begin() + first + half, leaves.begin() + first + count,
+                     [&axisOf](Leaf &a, Leaf &b) { return axisOf(a) < axisOf(b); });
+
+    // nodes may reallocate while building children, so assign after
+    int left = build(first, half);
+    int right = build(first + half, count - half);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+void BVH::draw()
+{
+    draw(ViewFrustum::current());
+}
+
+void BVH::draw(ViewFrustum frustum)
+{
+    stats = CullStats();
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // (node, fully inside) pairs; inside nodes skip further tests
+    std::vector<std::pair<int, bool>> stack = {{0, false}};
+    while (!stack.empty())
+    {
+        auto top = stack.back();
+        stack.pop_back();
+        auto &node = nodes[top.first];
+        bool inside = top.second;
+
+        if (!inside)
+        {
+            stats.tested++;
+            int visibility = frustum.classify(node.bounds);
+            if (visibility == 0)
+            {
+                stats.culled++;
+                continue;
+            }
+            inside = visibility == 2;
+        }
+
+        if (node.count > 0)
+        {
+            drawLeaves(node);
+        }
+        else
+        {
+            stack.push_back({node.right, inside});
+            stack.push_back({node.left, inside});
+        }
+    }
+}
+
+void BVH::drawLeaves(Node &node)
+{
+    for (int i = node.first; i < node.first + node.count; i++)
+    {
+        glPushMatrix();
+        glMultMatrixf(leaves[i].matrix.m);
+        leaves[i].drawable->draw();
+        glPopMatrix();
+        stats.drawn++;
+    }
+}
+
+void BVH::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    for (Leaf &leaf : leaves)
+    {
+        leaf.drawable->bakeInto(mesh, matrix * leaf.matrix);
+    }
+}
+
+int BVH::drawCalls()
+{
+    int calls = 0;
+    for (Leaf &leaf : leaves)
+    {
+        calls += leaf.drawable->drawCalls();
+    }
+    return calls;
+}
+
+/// @brief Every leaf, unculled; backends without a GL context have no view to cull against
+void BVH::render(RenderBackend *backend)
+{
+    for (Leaf &leaf : leaves)
+    {
+        backend->pushMatrix();
+        backend->multMatrix(leaf.matrix);
+        leaf.drawable->render(backend);
+        backend->popMatrix();
+    }
+}
+
+BoundingBox BVH::computeBounds()
+{
+    return nodes.empty() ? BoundingBox::empty() : nodes[0].bounds;
+}
+
+// -------- InstancedMesh -------- //
+
+InstancedMesh::InstancedMesh(BakedMesh *prototype)
+{
+    this->prototype = prototype;
+}
+
+InstancedMesh::~InstancedMesh()
+{
+    if (instanceBuffer)
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+    delete prototype;
+}
+
+void InstancedMesh::add(Mat4 transform, Vec3 tint)
+{
+    instances.push_back({transform, tint});
+    instancesDirty = true;
+    invalidateBounds();
+}
+
+/// @brief Program whose vertex shader is instanced.vert, or 0 to draw per instance
+void InstancedMesh::useProgram(int program)
+{
+    this->program = program;
+    if (!program)
+    {
+        matrixAttribute = instanceTintAttribute = tintAttribute = -1;
+        return;
+    }
+    matrixAttribute = glGetAttribLocation(program, "InstanceMatrix");
+    instanceTintAttribute = glGetAttribLocation(program, "InstanceTint");
+    tintAttribute = glGetAttribLocation(program, "Tint");
+}
+
+void InstancedMesh::draw()
+{
+    if (program && matrixAttribute >= 0)
+    {
+        drawInstanced();
+        return;
+    }
+
+    for (Instance &instance : instances)
+    {
+        glPushMatrix();
+        glMultMatrixf(instance.transform.m);
+        prototype->draw();
+        glPopMatrix();
+    }
+}
+
+void InstancedMesh::drawInstanced()
+{
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+    }
+
+    if (instancesDirty)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STATIC_DRAW);
+        instancesDirty = false;
+    }
+
+    int previousProgram;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    glUseProgram(program);
+
+    prototype->bind(tintAttribute);
+
+    // per instance attributes; a mat4 takes four consecutive locations
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (int col = 0; col < 4; col++)
+    {
+        glEnableVertexAttribArray(matrixAttribute + col);
+        glVertexAttribPointer(matrixAttribute + col, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              (void *)(offsetof(Instance, transform) + col * 4 * sizeof(float)));
+        glVertexAttribDivisor(matrixAttribute + col, 1);
+    }
+    if (instanceTintAttribute >= 0)
+    {
+        glEnableVertexAttribArray(instanceTintAttribute);
+        glVertexAttribPointer(instanceTintAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)offsetof(Instance, tint));
+        glVertexAttribDivisor(instanceTintAttribute, 1);
+    }
+
+    glDrawElementsInstanced(GL_TRIANGLES, prototype->indices.size(), GL_UNSIGNED_INT, 0, instances.size());
+
+    for (int col = 0; col < 4; col++)
+    {
+        glVertexAttribDivisor(matrixAttribute + col, 0);
+        glDisableVertexAttribArray(matrixAttribute + col);
+    }
+    if (instanceTintAttribute >= 0)
+    {
+        glVertexAttribDivisor(instanceTintAttribute, 0);
+        glDisableVertexAttribArray(instanceTintAttribute);
+    }
+
+    prototype->unbind(tintAttribute);
+    glUseProgram(previousProgram);
+}
+
+/// @brief Bakes every instance, tint included
+void InstancedMesh::bakeInto(Mesh *mesh, Mat4 matrix)
+{
+    for (Instance &instance : instances)
+    {
+        unsigned int first = mesh->verticies.size();
+        prototype->bakeInto(mesh, matrix * instance.transform);
+        for (unsigned int i = first; i < mesh->verticies.size(); i++)
+        {
+            auto &vertex = mesh->verticies[i];
+            vertex.color = vertex.color * (1 - vertex.tint) + instance.tint * vertex.tint;
+            vertex.tint = 0;
+        }
+    }
+}
+
+int InstancedMesh::drawCalls()
+{
+    return program ? 1 : instances.size();
+}
+
+void InstancedMesh::render(RenderBackend *backend)
+{
+    for (Instance &instance : instances)
+    {
+        backend->pushMatrix();
+        backend->multMatrix(instance.transform);
+        backend->drawMesh(*prototype, &instance.tint);
+        backend->popMatrix();
+    }
+}
+
+BoundingBox InstancedMesh::computeBounds()
+{
+    auto local = prototype->bounds();
+    auto bounds = BoundingBox::empty();
+    for (Instance &instance : instances)
+    {
+        bounds = bounds.merged(local.transformed(instance.transform));
+    }
+    return bounds;
 }
\ No newline at end of file
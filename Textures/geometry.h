@@ -1,6 +1,9 @@
+#pragma once
 #include <vector>
 #include <initializer_list>
+#include <atomic>
 #include "math.h"
+#include "arena.h"
 
 struct Vec3 {
     float x, y, z;
@@ -18,38 +21,186 @@ struct Vec3 {
     float* toArray();
 };
 
+/// @brief Column-major 4x4 matrix laid out like OpenGL's, so it can be
+/// handed to glMultMatrixf directly. Composes on the CPU without a context.
+struct Mat4 {
+    float m[16];
+    static Mat4 identity();
+    static Mat4 translation(Vec3 offset);
+    static Mat4 scaling(Vec3 scale);
+    static Mat4 rotation(float degrees, Vec3 axis);
+    static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar);
+    /// @brief Same matrix gluPerspective would multiply by.
+    static Mat4 perspective(float fovy, float aspect, float zNear, float zFar);
+    Mat4 operator*(Mat4 other);
+    Vec3 transformPoint(Vec3 point);
+    Vec3 transformDirection(Vec3 direction);
+    /// @brief Transform a surface normal (inverse transpose), renormalized.
+    Vec3 transformNormal(Vec3 normal);
+};
+
 struct BoundingBox {
     Vec3 min, max;
+    static BoundingBox empty();
     Vec3 center();
     Vec3 size();
+    bool isEmpty();
+    BoundingBox merged(BoundingBox other);
+    BoundingBox transformed(Mat4 matrix);
 };
 
+struct Mesh;
+class BakedMesh;
+class Box;
+class RenderBackend;
+
 struct Drawable {
+    // set by the Box that holds this drawable
+    Box *parent = nullptr;
+    // made by make() inside an Arena, which frees it rather than its parent
+    bool arenaOwned = false;
+
+    Drawable() {}
+    // a copy belongs to no Box or Arena and starts with stale caches
+    Drawable(const Drawable &) {}
+    Drawable &operator=(const Drawable &)
+    {
+        invalidateBounds();
+        return *this;
+    }
+
     virtual void draw() = 0;
     virtual ~Drawable() {};
-    virtual BoundingBox bounds() = 0;
+    /// @brief Cached bounds in the parent's coordinate space.
+    BoundingBox bounds();
+    /// @brief Cached bounds in the root's (world) coordinate space.
+    BoundingBox worldBounds();
+    /// @brief Mark this drawable's bounds and every ancestor's as stale.
+    void invalidateBounds();
+    /// @brief Mark world-space caches stale for this drawable and its subtree.
+    virtual void invalidateWorld();
+    /// @brief Append triangulated geometry, transformed by matrix, to a mesh.
+    virtual void bakeInto(Mesh *mesh, Mat4 matrix) = 0;
+    /// @brief Number of draw calls a single draw() issues.
+    virtual int drawCalls() = 0;
+    /// @brief draw() through any backend, GL or not.
+    virtual void render(RenderBackend *backend) = 0;
+
+    protected:
+        /// @brief Uncached bounds in the parent's coordinate space.
+        virtual BoundingBox computeBounds() = 0;
+
+    private:
+        BoundingBox cachedBounds;
+        BoundingBox cachedWorldBounds;
+        bool boundsDirty = true;
+        bool worldBoundsDirty = true;
+};
+
+/// @brief Non-owning view of contiguous items.
+template <class T>
+struct Span {
+    T *items;
+    size_t count;
+    T *begin() { return items; }
+    T *end() { return items + count; }
+    size_t size() { return count; }
+    T &operator[](size_t i) { return items[i]; }
+};
+
+/// @brief Vertex storage that keeps small polygons inline and only
+/// touches the heap past inlineCapacity vertices.
+class VertexList {
+    public:
+        static const unsigned int inlineCapacity = 4;
+
+        VertexList();
+        VertexList(std::initializer_list<Vec3> vertices);
+        VertexList(const std::vector<Vec3> &vertices);
+        VertexList(const VertexList &other);
+        VertexList(VertexList &&other);
+        VertexList &operator=(const VertexList &other);
+        VertexList &operator=(VertexList &&other);
+        ~VertexList();
+
+        void push_back(Vec3 vertex);
+        void reserve(unsigned int capacity);
+        void reverse();
+        unsigned int size() { return count; }
+        Vec3 &operator[](unsigned int i) { return items[i]; }
+        Vec3 *begin() { return items; }
+        Vec3 *end() { return items + count; }
+
+    private:
+        Vec3 local[inlineCapacity];
+        Vec3 *items = local;
+        unsigned int count = 0;
+        unsigned int capacity = inlineCapacity;
+};
+
+struct MeshVertex {
+    Vec3 position;
+    Vec3 normal;
+    Vec3 color;
+    // 1 where an instance tint replaces color, see Box::tinted
+    float tint;
+};
+
+/// @brief Indexed triangle list with per-vertex normal and color. The one
+/// format for CPU processing, drawing and GPU upload.
+struct Mesh {
+    std::vector<MeshVertex> verticies;
+    std::vector<unsigned int> indices;
+    // tint weight given to geometry added from now on
+    float tint = 0;
+
+    /// @brief Append a convex polygon as a triangle fan.
+    void addPolygon(VertexList &polygon, Vec3 normal, Vec3 color);
+    /// @brief Append another mesh, transformed by matrix.
+    void append(Mesh &other, Mat4 matrix);
+    /// @brief Append another mesh as is.
+    void append(Mesh &other);
+    /// @brief Merge vertices whose position, normal and color all agree
+    /// to within epsilon, so triangles share them.
+    void weld(float epsilon = 1e-4f);
+    BoundingBox positionBounds();
+    /// @brief Draw from client memory with one indexed call.
+    void drawArrays();
 };
 
 class Prism;
-class Box;
 
 struct Polygon : public Drawable {
-    std::vector<Vec3> verticies;
+    VertexList verticies;
     Vec3 color;
     
-    Polygon(std::vector<Vec3> vertices, Vec3 color);
-    Polygon(std::vector<Vec3> vertices);
+    Polygon(VertexList &&vertices, Vec3 color = {1, 1, 1});
+    Polygon(std::initializer_list<Vec3> vertices, Vec3 color = {1, 1, 1});
+    Polygon(const std::vector<Vec3> &vertices, Vec3 color = {1, 1, 1});
     Polygon operator+(Vec3 other);
     Polygon operator+(float scalar);
     Polygon operator-(Vec3 other);
     Polygon operator-(float scalar);
+    /// @brief In place variants; no allocation and no normal recalculation.
+    Polygon &operator+=(Vec3 other);
+    Polygon &operator+=(float scalar);
+    Polygon &operator-=(Vec3 other);
+    Polygon &operator-=(float scalar);
     Polygon reversed();
+    Polygon &reverse();
     Prism* extrude(Vec3 extrusion);
     void draw();
-    BoundingBox bounds();
+    void bakeInto(Mesh *mesh, Mat4 matrix);
+    int drawCalls();
+    void render(RenderBackend *backend);
+    Vec3 getNormal();
     
+    protected:
+        BoundingBox computeBounds();
+
     private:
         Vec3 normal;
+        void computeNormal();
 };
 
 class Frustum : public Drawable {
@@ -60,11 +211,37 @@ class Frustum : public Drawable {
         Frustum* painted(std::vector<Vec3> colors);
         Frustum* varigatePaint(float strength);
         void draw();
-        std::vector<Polygon> getPolygons();
-        BoundingBox bounds();
+        /// @brief Editable view of the faces. The mesh and bounds are marked
+        /// stale when it opens and again when it closes, so edits made through
+        /// it are never missed, even if the mesh is rebuilt in between.
+        class Faces : public Span<Polygon> {
+            public:
+                Faces(Frustum *owner);
+                Faces(Faces &&other);
+                Faces(const Faces &) = delete;
+                ~Faces();
+            private:
+                Frustum *owner;
+        };
+        /// @brief View of the faces, to edit in place while it is open.
+        Faces getPolygons();
+        /// @brief Triangulated, welded copy of the faces, rebuilt on first use
+        /// after they change. Safe to call from several threads at once, as
+        /// render() is while recording on workers; editing the faces is not.
+        Mesh &toMesh();
+        /// @brief Move every face in place.
+        Frustum* translate(Vec3 offset);
+        void bakeInto(Mesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
         Box* boxed();
+    protected:
+        BoundingBox computeBounds();
     private:
+        void facesChanged();
         std::vector<Polygon> polygons;
+        Mesh mesh;
+        std::atomic<bool> meshDirty{true};
 };
 
 class Prism : public Frustum {
@@ -75,21 +252,163 @@ class Prism : public Frustum {
 
 class Box : public Drawable {
     private:
-        float matrix[16];
+        Mat4 matrix;
+        Mat4 cachedWorldMatrix;
+        bool worldMatrixDirty = true;
         Vec3 scaleFactor = {1, 1, 1};
+        bool tintable = false;
+        void matrixChanged();
+
+    protected:
+        BoundingBox computeBounds();
 
     public:
+        // read freely, but modify through add/remove so cached bounds stay valid
         std::vector<Drawable*> children;
         
         Box(std::vector<Drawable*> children);
         Box(std::initializer_list<Drawable*> children);
         ~Box();
 
+        void add(Drawable *child);
+        void remove(Drawable *child);
         void identity();
-        BoundingBox bounds();
+        /// @brief Transform from this box's local space to world space.
+        Mat4 worldMatrix();
+        void invalidateWorld();
         void draw();
+        void bakeInto(Mesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+        BakedMesh* baked();
+        /// @brief Let instances recolor this subtree with their tint.
+        Box* tinted();
         Box* scale(Vec3 scale);
         Box* scale(float scale);
         Box* move(Vec3 pos);
         Box* rotate(Vec3 rot);
+};
+
+/// @brief Static geometry flattened into one interleaved vertex buffer
+/// and drawn with a single indexed call. Uploaded lazily on first draw.
+class BakedMesh : public Drawable, public Mesh {
+    public:
+        // draw calls the source hierarchy would have issued, minus this one
+        int savedDrawCalls = 0;
+
+        BakedMesh();
+        ~BakedMesh();
+
+        /// @brief Bind buffers and vertex arrays. Tint goes to the given
+        /// generic attribute when it is not -1.
+        void bind(int tintAttribute = -1);
+        void unbind(int tintAttribute = -1);
+        void draw();
+        void bakeInto(Mesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        unsigned int vertexBuffer = 0;
+        unsigned int indexBuffer = 0;
+        void upload();
+};
+
+/// @brief View volume as six inward facing planes (ax + by + cz + d >= 0 inside).
+struct ViewFrustum {
+    float planes[6][4];
+    /// @brief Planes of a combined projection * modelview matrix.
+    static ViewFrustum fromMatrix(Mat4 clip);
+    /// @brief Planes of the current GL projection and modelview matrices.
+    static ViewFrustum current();
+    /// @brief 0 if outside, 1 if intersecting, 2 if fully inside.
+    int classify(BoundingBox box);
+};
+
+struct CullStats {
+    int tested = 0;
+    int culled = 0;
+    int drawn = 0;
+};
+
+/// @brief Bounding volume hierarchy over the leaves of a Box tree, built from
+/// their world bounds. Drawing skips subtrees outside the current view frustum.
+/// It is a snapshot; call rebuild() after the tree changes.
+class BVH : public Drawable {
+    public:
+        // stats from the most recent draw()
+        CullStats stats;
+        int leafCount();
+
+        BVH(Box *root);
+        void rebuild();
+        void draw();
+        void draw(ViewFrustum frustum);
+        void bakeInto(Mesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        struct Node {
+            BoundingBox bounds;
+            // children for interior nodes, leaves[first, first + count) otherwise
+            int left, right;
+            int first, count;
+        };
+        struct Leaf {
+            Drawable *drawable;
+            Mat4 matrix;
+            BoundingBox bounds;
+        };
+
+        Box *root;
+        std::vector<Node> nodes;
+        std::vector<Leaf> leaves;
+        void collect(Drawable *drawable);
+        int build(int first, int count);
+        void drawLeaves(Node &node);
+};
+
+struct Instance {
+    Mat4 transform;
+    Vec3 tint;
+};
+
+/// @brief Many placements of one shared prototype mesh. Each instance holds
+/// only a transform and a tint, and all are drawn with one instanced call.
+/// Needs a program built from instanced.vert; without one it falls back to
+/// a draw per instance with no tint.
+class InstancedMesh : public Drawable {
+    public:
+        BakedMesh *prototype;
+        std::vector<Instance> instances;
+
+        /// @brief Takes ownership of the prototype.
+        InstancedMesh(BakedMesh *prototype);
+        ~InstancedMesh();
+
+        void add(Mat4 transform, Vec3 tint);
+        void useProgram(int program);
+        void draw();
+        void bakeInto(Mesh *mesh, Mat4 matrix);
+        int drawCalls();
+        void render(RenderBackend *backend);
+
+    protected:
+        BoundingBox computeBounds();
+
+    private:
+        int program = 0;
+        int matrixAttribute = -1;
+        int instanceTintAttribute = -1;
+        int tintAttribute = -1;
+        unsigned int instanceBuffer = 0;
+        bool instancesDirty = true;
+        void drawInstanced();
 };
\ No newline at end of file
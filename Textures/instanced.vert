@@ -0,0 +1,33 @@
+//  Per Pixel Lighting shader for instanced drawing
+//  Pairs with pixlight.frag
+#version 120
+
+//  Per instance
+attribute mat4 InstanceMatrix;
+attribute vec3 InstanceTint;
+//  Per vertex: how much the instance tint replaces the vertex color
+attribute float Tint;
+
+varying vec3 View;
+varying vec3 Light;
+varying vec3 Normal;
+varying vec4 Color;
+
+void main()
+{
+   //  Place the shared mesh for this instance
+   vec4 Vertex = InstanceMatrix * gl_Vertex;
+   mat3 InstanceRotation = mat3(InstanceMatrix[0].xyz, InstanceMatrix[1].xyz, InstanceMatrix[2].xyz);
+   //  Vertex location in modelview coordinates
+   vec4 P = gl_ModelViewMatrix * Vertex;
+   //  Light position
+   Light  = gl_LightSource[0].position.xyz - P.xyz;
+   //  Normal
+   Normal = gl_NormalMatrix * (InstanceRotation * gl_Normal);
+   //  Eye position
+   View  = -P.xyz;
+   //  Vertex color, replaced by the instance tint where marked
+   Color = mix(gl_Color, vec4(InstanceTint, 1.0), Tint);
+   //  Set vertex position
+   gl_Position = gl_ModelViewProjectionMatrix * Vertex;
+}
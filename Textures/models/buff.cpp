@@ -38,7 +38,7 @@ Box *buildLeg()
                     ->scale({1.15, 1, 1.15})
                     ->move({-.08, 0, 0});
 
-    return new Box({leg, foot});
+    return make<Box>({leg, foot});
 }
 
 Box *buildHorn()
@@ -63,7 +63,7 @@ Box *buildHorn()
                   ->boxed()
                   ->move({-1.5, 0, 0});
 
-    return (new Box({b1, b2}))
+    return (make<Box>({b1, b2}))
         ->scale({.4, .6, .4});
 }
 
@@ -98,13 +98,13 @@ Box *buildHead()
     auto horn2 = buildHorn()
                      ->rotate({0, 180, 0})
                      ->move({-2.5, 0, -.8});
-    auto horns = (new Box({horn1, horn2}))
+    auto horns = (make<Box>({horn1, horn2}))
                      ->move({0, .8, .65});
 
     auto eye1 = buildEye();
     auto eye2 = buildEye()
                     ->move({1.25, 0, 0});
-    auto eyes = new Box({eye1, eye2});
+    auto eyes = make<Box>({eye1, eye2});
 
     auto mouth = Polygon({
                              {0, 0, 0},
@@ -130,11 +130,11 @@ Box *buildHead()
                      ->scale({2.4, .5, .3})
                      ->move({2.45, 1.5, 1.8});
 
-    int i = rand() % 3;
-    auto partyHat = buildCone(2, 1, 100, pall.hats[i])
+    auto partyHat = buildCone(2, 1, 100, randomHatColor())
+                        ->tinted()
                         ->move({1.25, 2, 1.1});
 
-    return new Box({head, horns, eyes, mouth, eyebrow, partyHat});
+    return make<Box>({head, horns, eyes, mouth, eyebrow, partyHat});
 }
 
 Box *buildTail(){
@@ -156,10 +156,15 @@ Box *buildTail(){
                    ->scale({1, 2, 1.3})
                    ->move({0, -.68, -2.5});
     
-    return new Box({base, tip});
+    return make<Box>({base, tip});
 }
 
 // public
+Vec3 randomHatColor()
+{
+    return pall.hats[rand() % 3];
+}
+
 Box *buildBuff()
 {
     auto body = Polygon({
@@ -171,7 +176,7 @@ Box *buildBuff()
                         pall.body)
                     .extrude({0, 0, 4});
 
-    auto legs = (new Box({
+    auto legs = (make<Box>({
                      buildLeg(),
                      buildLeg()->move({2.5, 0, 0}),
                      buildLeg()->move({2.5, 0, 4}),
@@ -188,5 +193,5 @@ Box *buildBuff()
                     ->scale({.9, .5, .5})
                     ->move({.7, .5, 0});
 
-    return new Box({body, legs, head, tail});
+    return make<Box>({body, legs, head, tail});
 }
\ No newline at end of file
@@ -5,4 +5,5 @@
     #define _GEOMETRY_H_
 #endif
 
-Box *buildBuff();
\ No newline at end of file
+Box *buildBuff();
+Vec3 randomHatColor();
\ No newline at end of file
@@ -17,13 +17,13 @@ Box *buildCone(float height, float radius, int slices, Vec3 color) {
         Vec3 p2 = {radius * Cos(nextTheta), 0, radius * Sin(nextTheta)};
         Vec3 p3 = {0, height, 0};
         
-        Polygon *side = new Polygon({p3, p2, p1}, color);
+        Polygon *side = make<Polygon>(std::vector<Vec3>{p3, p2, p1}, color);
         polygons.push_back(side);
         baseVerts.push_back(p1);
     }
     
-    Polygon *base = new Polygon(baseVerts, color);
+    Polygon *base = make<Polygon>(baseVerts, color);
     polygons.push_back(base);
     
-    return new Box(polygons);
+    return make<Box>(polygons);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 varying vec3 View;
 varying vec3 Light;
 varying vec3 Normal;
+varying vec4 Color;
 
 void main()
 {
@@ -22,8 +23,10 @@ void main()
    float Is = (Id>0.0) ? pow(max(dot(R,V),0.0) , gl_FrontMaterial.shininess) : 0.0;
 
    //  Sum color types
+   //  Ambient and diffuse use the vertex color directly (GL_COLOR_MATERIAL
+   //  only tracks glColor between draws, not per-vertex color arrays)
    gl_FragColor = gl_FrontMaterial.emission
-                + gl_FrontLightProduct[0].ambient
-                + Id*gl_FrontLightProduct[0].diffuse
+                + Color*gl_LightSource[0].ambient
+                + Id*Color*gl_LightSource[0].diffuse
                 + Is*gl_FrontLightProduct[0].specular;
 }
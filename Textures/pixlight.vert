@@ -4,6 +4,7 @@
 varying vec3 View;
 varying vec3 Light;
 varying vec3 Normal;
+varying vec4 Color;
 
 void main()
 {
@@ -15,6 +16,8 @@ void main()
    Normal = gl_NormalMatrix * gl_Normal;
    //  Eye position
    View  = -P.xyz;
+   //  Vertex color (tracks glColor and color arrays alike)
+   Color = gl_Color;
    //  Set vertex position
    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
 }
@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <cstdint>
+#ifndef _GEOMETRY_H_
+    #include "geometry.h"
+    #define _GEOMETRY_H_
+#endif
+
+/// @brief Where Drawable::render() sends geometry. Lets the same scene go
+/// to OpenGL or to a CPU rasterizer that needs no context.
+class RenderBackend {
+    public:
+        virtual ~RenderBackend() {}
+        virtual void pushMatrix() = 0;
+        virtual void multMatrix(Mat4 matrix) = 0;
+        virtual void popMatrix() = 0;
+        virtual void drawPolygon(Polygon &polygon) = 0;
+        /// @brief Draw a mesh, replacing tinted vertex colors with tint when given.
+        virtual void drawMesh(Mesh &mesh, Vec3 *tint = nullptr) = 0;
+};
+
+/// @brief Immediate mode OpenGL, the same calls draw() makes.
+class GLBackend : public RenderBackend {
+    public:
+        void pushMatrix();
+        void multMatrix(Mat4 matrix);
+        void popMatrix();
+        void drawPolygon(Polygon &polygon);
+        void drawMesh(Mesh &mesh, Vec3 *tint = nullptr);
+};
+
+/// @brief Light 0 and material as pixlight.frag sees them. The position is
+/// in eye space, like GL_POSITION after the modelview transform.
+struct SoftwareLight {
+    Vec3 position = {0, 0, 1};
+    Vec3 ambient = {0, 0, 0};
+    Vec3 diffuse = {1, 1, 1};
+    Vec3 specular = {1, 1, 1};
+    // GL's default material has no specular, and GL_COLOR_MATERIAL leaves it alone
+    Vec3 materialSpecular = {0, 0, 0};
+    Vec3 emission = {0, 0, 0};
+    float shininess = 16;
+};
+
+/// @brief CPU rasterizer following the GL pipeline the scenes use: depth test
+/// with GL_LESS, back faces culled with CCW fronts, and per pixel lighting
+/// from pixlight.frag. Triangles are binned into screen tiles and the tiles
+/// shaded in parallel, each in submission order, so output does not depend
+/// on the thread count.
+class SoftwareRasterizer : public RenderBackend {
+    public:
+        static const int tileSize = 64;
+
+        int width, height;
+        Mat4 projection;
+        SoftwareLight light;
+        // RGB, bottom row first like glReadPixels
+        std::vector<unsigned char> pixels;
+        std::vector<float> depth;
+
+        SoftwareRasterizer(int width, int height, int threads = std::thread::hardware_concurrency());
+
+        void clear(Vec3 color);
+        void loadMatrix(Mat4 matrix);
+        Mat4 modelview();
+        void pushMatrix();
+        void multMatrix(Mat4 matrix);
+        void popMatrix();
+        void drawPolygon(Polygon &polygon);
+        void drawMesh(Mesh &mesh, Vec3 *tint = nullptr);
+        /// @brief Rasterize everything drawn since clear() into pixels.
+        void finish();
+        /// @brief Write pixels as a binary PPM. Returns false on failure.
+        bool writePPM(const char *path);
+        int triangleCount();
+
+    private:
+        struct Vertex {
+            // clip space position
+            float clipX, clipY, clipZ, clipW;
+            // window x, y and NDC z, then 1 / clip w, once projected
+            float x, y, z, invW;
+            Vec3 eye, normal, color;
+        };
+        struct Triangle {
+            Vertex v[3];
+        };
+
+        int threads;
+        int tilesX, tilesY;
+        std::vector<Mat4> stack;
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<int>> bins;
+        Vec3 clearColor = {0, 0, 0};
+
+        Vertex transform(Vec3 position, Vec3 normal, Vec3 color);
+        void project(Vertex &vertex);
+        /// @brief Point t of the way from a to b, in clip space where every
+        /// attribute is still linear.
+        static Vertex lerp(Vertex &a, Vertex &b, float t);
+        /// @brief Clip against the near plane, then bin what is left.
+        void addTriangle(Vertex &a, Vertex &b, Vertex &c);
+        void addProjected(Vertex &a, Vertex &b, Vertex &c);
+        void rasterizeTile(int tile);
+        Vec3 shade(Vec3 eye, Vec3 normal, Vec3 color);
+};
+
+/// @brief Records draws as sortable commands instead of issuing them. Keys
+/// order commands by state (primitive and color), then transform; submit()
+/// then merges each run of one state into a single indexed draw, moving
+/// vertices by their transforms on the CPU. Buffers can be recorded on
+/// worker threads, one per thread, and joined with append().
+class CommandBuffer : public RenderBackend {
+    public:
+        enum Primitive { POLYGON = 0, MESH = 1 };
+        // key bits below this are the transform, the rest is state
+        static const int stateShift = 31;
+
+        struct Command {
+            uint64_t key;
+            Primitive primitive;
+            // index into transforms
+            int transform;
+            Polygon *polygon;
+            Mesh *mesh;
+            bool tinted;
+            Vec3 tint;
+        };
+
+        struct Stats {
+            int commands = 0;
+            // runs of one state, one glDrawElements each
+            int batches = 0;
+        };
+
+        // recorded commands, sorted after sort() or submit()
+        std::vector<Command> commands;
+        // transforms relative to the modelview at submit time
+        std::vector<Mat4> transforms;
+        // what the last sort() planned
+        Stats stats;
+
+        CommandBuffer();
+        void clear();
+        /// @brief Move another buffer's commands onto the end of this one.
+        void append(CommandBuffer &other);
+        void sort();
+        /// @brief Sort, then draw with OpenGL.
+        void submit();
+        /// @brief Sort, then draw through another backend.
+        void replay(RenderBackend *backend);
+
+        void pushMatrix();
+        void multMatrix(Mat4 matrix);
+        void popMatrix();
+        void drawPolygon(Polygon &polygon);
+        void drawMesh(Mesh &mesh, Vec3 *tint = nullptr);
+
+    private:
+        std::vector<int> stack;
+        // reused across submits so merging does not allocate per frame
+        Mesh batch;
+
+        static uint64_t makeKey(Primitive primitive, int transform, Vec3 color);
+        void record(Command command, Vec3 color);
+        void merge(Command &command);
+        unsigned int mergeRun(unsigned int i);
+};
@@ -1,7 +1,11 @@
 #include "CSCIx229.h"
+#include <chrono>
 
 #include "models/buff.h"
 #include "loadShader.h"
+#include "appLoop.h"
+#include "bench.h"
+#include "render.h"
 
 struct OrbitParams
 {
@@ -35,6 +39,19 @@ struct LightParams {
 } light;
 
 Box *scene;
+BakedMesh *bakedScene;
+bool drawBaked = true;
+CommandBuffer commands;
+bool drawCommands = false;
+
+InstancedMesh *herd;
+int herdSize = 0;
+bool runBenchmarks = false;
+int instanceShader = 0;
+bool drawInstanced = true;
+Vec3 background;
+int headlessFrames = 0;
+const char *headlessImage = "headless.ppm";
 
 #define LEN 8192 //  Maximum length of text string
 void Print(const char *format, ...)
@@ -93,22 +110,29 @@ void draw()
       glPopMatrix();
     }
 
-   scene->draw();
+   if (drawBaked)
+      bakedScene->draw();
+   else if (drawCommands)
+   {
+      commands.clear();
+      scene->render(&commands);
+      commands.submit();
+   }
+   else
+      scene->draw();
    glutSwapBuffers();
    glFlush();
 }
 
-// -------- Idle Hook -------- //
-void idle()
+// -------- Animation Hook -------- //
+void orbitLight(double t)
 {
    // -------------- Handle orbitting light source
-   float dt = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
-   light.pos.x = light.radius * cos(dt * light.speed);
-   light.pos.z = light.radius * sin(dt * light.speed);
+   light.pos.x = light.radius * cos(t * light.speed);
+   light.pos.z = light.radius * sin(t * light.speed);
    int directional = !light.directional ? 1 : 0;
    const float pos[] = {light.pos.x, light.pos.y, light.pos.z, (float) directional};
    glLightfv(GL_LIGHT0, GL_POSITION, pos);
-   glutPostRedisplay();
 }
 
 // -------- Window Reshape -------- //
@@ -130,8 +154,56 @@ void reshape(int width, int height)
    glLoadIdentity();
 }
 
+/// @brief Say how the frame is drawn now and what it costs in draw calls.
+void reportDrawing()
+{
+   if (drawBaked)
+      printf("Drawing baked: floor and %lu buffs in %d draw call per frame\n",
+             herd->instances.size(), bakedScene->drawCalls());
+   else if (drawCommands)
+   {
+      commands.clear();
+      scene->render(&commands);
+      commands.sort();
+      printf("Drawing through the command buffer: %d commands in %d draw calls per frame\n",
+             commands.stats.commands, commands.stats.batches);
+   }
+   else
+      printf("Drawing immediate: herd %s, %d draw calls per frame\n",
+             drawInstanced ? "instanced" : "per instance", scene->drawCalls());
+}
+
 void key(unsigned char ch, int x, int y)
 {
+   // space stops and starts the light
+   if (ch == ' ')
+      appLoopAnimate(!appLoop.animating);
+   // the whole frame from one baked buffer, or the floor and herd live
+   else if (ch == 'b')
+   {
+      drawBaked = !drawBaked;
+      drawCommands = false;
+      reportDrawing();
+      glutPostRedisplay();
+   }
+   // live drawing goes through a sorted command buffer
+   else if (ch == 'c')
+   {
+      drawCommands = !drawCommands;
+      drawBaked = false;
+      reportDrawing();
+      glutPostRedisplay();
+   }
+   // toggle between one instanced draw and a draw per buff, drawn live
+   else if (ch == 'i')
+   {
+      drawInstanced = !drawInstanced;
+      herd->useProgram(drawInstanced ? instanceShader : 0);
+      drawBaked = false;
+      drawCommands = false;
+      reportDrawing();
+      glutPostRedisplay();
+   }
 }
 
 // -------- Special -------- //
@@ -165,45 +237,40 @@ void special(int key, int x, int y)
    glutPostRedisplay();
 }
 
-// -------- Visibility -------- //
-void visible(int vis)
-{
-   if (vis == GLUT_VISIBLE)
-      glutIdleFunc(idle);
-   else
-      glutIdleFunc(NULL);
-}
-
 void initScene()
 {
    auto theme = Vec3{.4, .5, 1}.normalized();
-   auto bgColor = theme * .2;
+   background = theme * .2;
    auto floorColor = theme * .8; 
-   
-   glClearColor(bgColor.x, bgColor.y, bgColor.z, 1);
-
-   auto mainBuff = buildBuff()
-                       ->rotate({0, (float)(rand() % 360), 0});
-
-   auto altBuff = buildBuff()
-                      ->scale(.4)
-                      ->move({3, -1.3, -4})
-                      ->rotate({0, (float)(rand() % 360) + 0, 0});
 
-   auto altBuff2 = buildBuff()
-                       ->scale(.4)
-                       ->move({6, -1.3, -6})
-                       ->rotate({0, (float)(rand() % 360) + 0, 0});
-
-   auto altBuff3 = buildBuff()
-                       ->scale(.4)
-                       ->move({-5, -1.3, -3})
-                       ->rotate({0, (float)(rand() % 360) + 0, 0});
+   // the buff is built once and placed many times
+   auto start = std::chrono::steady_clock::now();
+   auto buff = buildBuff();
+   herd = new InstancedMesh(buff->baked());
+   delete buff;
+
+   // same as ->scale(scale)->move(pos)->rotate({0, yaw, 0}) on a Box
+   auto placement = [](Vec3 pos, float scale, float yaw) {
+      return Mat4::translation(pos) * Mat4::scaling({scale, scale, scale}) * Mat4::rotation(yaw, {0, 1, 0});
+   };
+
+   herd->add(placement({0, 0, 0}, 1, rand() % 360), randomHatColor());
+   herd->add(placement({3, -1.3, -4}, .4, rand() % 360), randomHatColor());
+   herd->add(placement({6, -1.3, -6}, .4, rand() % 360), randomHatColor());
+   herd->add(placement({-5, -1.3, -3}, .4, rand() % 360), randomHatColor());
+   herd->add(placement({6, -1.3, 5}, .4, rand() % 360), randomHatColor());
+
+   // optional generated herd spread on a grid
+   int side = ceil(sqrt(herdSize));
+   for (int i = 0; i < herdSize; i++)
+   {
+      Vec3 pos = {(float)(i % side - side / 2) * 2.5f, -1.3, (float)(i / side - side / 2) * 2.5f};
+      herd->add(placement(pos, .4, rand() % 360), randomHatColor());
+   }
 
-   auto altBuff4 = buildBuff()
-                       ->scale(.4)
-                       ->move({6, -1.3, 5})
-                       ->rotate({0, (float)(rand() % 360) + 0, 0});
+   std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   printf("Herd of %lu buffs: %lu shared vertices, %lu bytes per instance, built in %.2f ms\n",
+          herd->instances.size(), herd->prototype->verticies.size(), sizeof(Instance), elapsed.count());
 
    auto floor = Polygon({
                             {0, 0, 0},
@@ -217,7 +284,15 @@ void initScene()
                     ->scale({16, 1, 16})
                     ->move({-8, -2, -8});
 
-   scene = new Box({mainBuff, altBuff, altBuff2, altBuff3, altBuff4, floor});
+   scene = new Box({floor, herd});
+
+   // nothing in the scene moves, so the floor and every buff, tinted, also
+   // flatten into one buffer; measured against a draw per buff
+   start = std::chrono::steady_clock::now();
+   bakedScene = scene->baked();
+   elapsed = std::chrono::steady_clock::now() - start;
+   printf("Baked %lu triangles in %.2f ms, saving %d draw calls per frame\n",
+          bakedScene->indices.size() / 3, elapsed.count(), bakedScene->savedDrawCalls);
 }
 
 void initLighting() {
@@ -242,10 +317,79 @@ void initLighting() {
    // load shader
    int shader1 = CreateShaderProg("pixlight.vert", "pixlight.frag");
    glUseProgram(shader1);
+
+   instanceShader = CreateShaderProg("instanced.vert", "pixlight.frag");
+   herd->useProgram(instanceShader);
+}
+
+// -------- Headless -------- //
+/// @brief Time the floor and buff herd through the software rasterizer, as 'b'
+/// currently picks (baked or live), while the light makes its orbit; then
+/// write the last frame. No axes or light marker.
+int renderHeadless(int frames, const char *path)
+{
+   const int size = 600;
+   SoftwareRasterizer raster(size, size);
+   const float dim = orbit.dim;
+   raster.projection = Mat4::orthographic(-dim, dim, -dim, dim, -dim, dim * 2);
+   raster.light.ambient = light.color * light.ambient;
+   raster.light.diffuse = light.color * light.diffuse;
+   raster.light.specular = light.color * light.specular;
+   raster.light.shininess = light.shininess;
+
+   auto view = Mat4::rotation(orbit.pitch, {1, 0, 0}) * Mat4::rotation(orbit.yaw, {0, 1, 0});
+   auto start = std::chrono::steady_clock::now();
+   for (int frame = 0; frame < frames; frame++)
+   {
+      // orbitLight() would touch GL, so step the orbit here at appLoop's rate
+      float t = frame / (double) appLoop.fps;
+      light.pos.x = light.radius * cos(t * light.speed);
+      light.pos.z = light.radius * sin(t * light.speed);
+      raster.light.position = light.directional ? view.transformDirection(light.pos) : view.transformPoint(light.pos);
+
+      raster.clear(background);
+      raster.loadMatrix(view);
+      if (drawBaked)
+         bakedScene->render(&raster);
+      else
+         scene->render(&raster);
+      raster.finish();
+   }
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   printf("Rendered %d frames of %d triangles at %dx%d in %.2f s (%.1f FPS)\n",
+          frames, raster.triangleCount(), size, size, elapsed.count(), frames / elapsed.count());
+   if (!raster.writePPM(path))
+   {
+      fprintf(stderr, "Could not write %s\n", path);
+      return 1;
+   }
+   printf("Wrote %s\n", path);
+   return 0;
 }
 
 int main(int argc, char *argv[])
 {
+   // -herd N adds N more buffs to the scene
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-herd") == 0 && i + 1 < argc)
+         herdSize = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-bench") == 0)
+         runBenchmarks = true;
+      else if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+         headlessFrames = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "-ppm") == 0 && i + 1 < argc)
+         headlessImage = argv[i + 1];
+   }
+
+   // the rasterizer needs only the scene and its lights, not a window
+   if (headlessFrames > 0)
+   {
+      initScene();
+      return renderHeadless(headlessFrames, headlessImage);
+   }
+
    //  Initialize GLUT and process user parameters
    glutInit(&argc, argv);
 
@@ -277,12 +421,24 @@ int main(int argc, char *argv[])
 
    initScene();
    initLighting();
+   glClearColor(background.x, background.y, background.z, 1);
+
+   if (runBenchmarks)
+   {
+      benchmarkArena(herdSize > 0 ? herdSize : 500, 10);
+      bool passed = checkNormals();
+      passed = checkAllocations() && passed;
+      passed = checkClipping() && passed;
+      passed = checkCommandBuffer(herdSize > 0 ? herdSize : 500, 4) && passed;
+      return passed ? 0 : 1;
+   }
 
    glutDisplayFunc(draw);
    glutReshapeFunc(reshape);
    glutKeyboardFunc(key);
    glutSpecialFunc(special);
-   glutVisibilityFunc(visible);
+   // the light orbits at up to 60 frames per second
+   appLoopInit(orbitLight);
 
    glutMainLoop();
    return 0; /* ANSI C requires main to return int. */